@@ -80,7 +80,6 @@ static AppState_t appState = APP_STATE_INITIAL;
 static SYS_Timer_t appTimer;
 static NWK_DataReq_t appDataReq;
 static bool appDataReqBusy = false;
-static uint8_t appDataReqBuffer[APP_BUFFER_SIZE];
 static uint8_t appUartBuffer[APP_BUFFER_SIZE];
 static uint8_t appUartBufferPtr = 0;
 
@@ -100,17 +99,21 @@ static void appSendData(void)
   if (appDataReqBusy || 0 == appUartBufferPtr)
     return;
 
-  memcpy(appDataReqBuffer, appUartBuffer, appUartBufferPtr);
-
   //appDataReq.dstAddr = 1-APP_ADDR;
   appDataReq.dstAddr = 0xffff;
-  appDataReq.dstEndpoint = APP_ENDPOINT;
-  appDataReq.srcEndpoint = APP_ENDPOINT;
   appDataReq.options = NWK_OPT_ENABLE_SECURITY;
-  appDataReq.data = appDataReqBuffer;
   appDataReq.size = appUartBufferPtr;
+
+  // Keep the data in the UART buffer and retry on the next flush
+  if (NULL == NWK_DataReqReserve(&appDataReq))
+    return;
+
+  memcpy(appDataReq.data, appUartBuffer, appUartBufferPtr);
+
+  appDataReq.dstEndpoint = APP_ENDPOINT;
+  appDataReq.srcEndpoint = APP_ENDPOINT;
   appDataReq.confirm = appDataConf;
-  NWK_DataReq(&appDataReq);
+  NWK_DataReqCommit(&appDataReq);
   ledToggle(0);
 
   appUartBufferPtr = 0;
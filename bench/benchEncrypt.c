@@ -0,0 +1,163 @@
+/**
+ * \file benchEncrypt.c
+ *
+ * \brief AES-128 known-answer test and block cipher benchmark
+ *
+ * Copyright (C) 2012 Atmel Corporation. All rights reserved.
+ *
+ * \asf_license_start
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. The name of Atmel may not be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * 4. This software may only be redistributed and used in connection with an
+ *    Atmel microcontroller product.
+ *
+ * THIS SOFTWARE IS PROVIDED BY ATMEL "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT ARE
+ * EXPRESSLY AND SPECIFICALLY DISCLAIMED. IN NO EVENT SHALL ATMEL BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * \asf_license_stop
+ *
+ * $Id$
+ *
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "sysConfig.h"
+#include "sysEncrypt.h"
+#include "benchStub.h"
+
+/*****************************************************************************
+*****************************************************************************/
+#define BENCH_BLOCKS         2000000
+
+#if SYS_SECURITY_MODE == 1
+  #define BENCH_CIPHER       "XTEA (2 x 64-bit blocks)"
+#elif defined(__AES__)
+  #define BENCH_CIPHER       "AES-128, AES-NI"
+#else
+  #define BENCH_CIPHER       "AES-128, table"
+#endif
+
+/*****************************************************************************
+*****************************************************************************/
+typedef struct BenchVector_t
+{
+  uint8_t    key[16];
+  uint8_t    plain[16];
+  uint8_t    cipher[16];
+} BenchVector_t;
+
+/*****************************************************************************
+*****************************************************************************/
+#if SYS_SECURITY_MODE == 2
+// FIPS-197 appendix B and appendix C.1
+static const BenchVector_t benchVectors[] =
+{
+  {
+    { 0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6, 0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c },
+    { 0x32, 0x43, 0xf6, 0xa8, 0x88, 0x5a, 0x30, 0x8d, 0x31, 0x31, 0x98, 0xa2, 0xe0, 0x37, 0x07, 0x34 },
+    { 0x39, 0x25, 0x84, 0x1d, 0x02, 0xdc, 0x09, 0xfb, 0xdc, 0x11, 0x85, 0x97, 0x19, 0x6a, 0x0b, 0x32 },
+  },
+  {
+    { 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f },
+    { 0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88, 0x99, 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff },
+    { 0x69, 0xc4, 0xe0, 0xd8, 0x6a, 0x7b, 0x04, 0x30, 0xd8, 0xcd, 0xb7, 0x80, 0x70, 0xb4, 0xc5, 0x5a },
+  },
+};
+#endif
+
+static uint32_t benchConfirms;
+
+/*****************************************************************************
+*****************************************************************************/
+void SYS_EncryptConf(void)
+{
+  benchConfirms++;
+}
+
+#if SYS_SECURITY_MODE == 2
+/*****************************************************************************
+*****************************************************************************/
+static bool benchKnownAnswerTest(void)
+{
+  bool passed = true;
+
+  for (uint8_t i = 0; i < sizeof(benchVectors) / sizeof(benchVectors[0]); i++)
+  {
+    uint8_t key[16], text[16];
+    uint32_t confirms = benchConfirms;
+
+    memcpy(key, benchVectors[i].key, sizeof(key));
+    memcpy(text, benchVectors[i].plain, sizeof(text));
+    SYS_EncryptReq(text, key);
+
+    if (memcmp(text, benchVectors[i].cipher, sizeof(text)) ||
+        memcmp(key, benchVectors[i].key, sizeof(key)) ||
+        benchConfirms != confirms + 1)
+    {
+      printf("%s: vector %d failed\n", BENCH_CIPHER, i);
+      passed = false;
+    }
+  }
+
+  return passed;
+}
+#endif
+
+/*****************************************************************************
+*****************************************************************************/
+int main(int argc, char **argv)
+{
+  uint8_t key[16] = "TestSecurityKey0";
+  uint8_t text[16] = { 0 };
+  double start, block;
+
+#if defined(__AES__)
+  if (!__builtin_cpu_supports("aes"))
+  {
+    printf("%-28s skipped, no AES-NI on this CPU\n", BENCH_CIPHER);
+    return 0;
+  }
+#endif
+
+#if SYS_SECURITY_MODE == 2
+  if (!benchKnownAnswerTest())
+    return 1;
+#endif
+
+  // "test" runs only the known-answer test
+  if (argc > 1 && 0 == strcmp(argv[1], "test"))
+    return 0;
+
+  start = benchTime();
+  for (uint32_t i = 0; i < BENCH_BLOCKS; i++)
+    SYS_EncryptReq(text, key);
+  block = (benchTime() - start) / BENCH_BLOCKS;
+
+  printf("%-28s %10.1f\n", BENCH_CIPHER, block);
+
+  return benchConfirms < BENCH_BLOCKS;
+}
@@ -0,0 +1,155 @@
+/**
+ * \file benchFrame.c
+ *
+ * \brief Main loop cost as the number of frame buffers grows
+ *
+ * Copyright (C) 2012 Atmel Corporation. All rights reserved.
+ *
+ * \asf_license_start
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. The name of Atmel may not be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * 4. This software may only be redistributed and used in connection with an
+ *    Atmel microcontroller product.
+ *
+ * THIS SOFTWARE IS PROVIDED BY ATMEL "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT ARE
+ * EXPRESSLY AND SPECIFICALLY DISCLAIMED. IN NO EVENT SHALL ATMEL BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * \asf_license_stop
+ *
+ * $Id$
+ *
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "phy.h"
+#include "nwk.h"
+#include "sysTimer.h"
+#include "benchStub.h"
+
+/*****************************************************************************
+*****************************************************************************/
+#define BENCH_LOOPS          1000000
+#define BENCH_REQUESTS       200000
+#define BENCH_PARKED         (NWK_BUFFERS_AMOUNT - 2)
+
+/*****************************************************************************
+*****************************************************************************/
+static NWK_DataReq_t benchParkedReq[BENCH_PARKED];
+static NWK_DataReq_t benchReq;
+static uint8_t benchData[16];
+static bool benchConfirmed;
+
+/*****************************************************************************
+*****************************************************************************/
+static void benchParkedConf(NWK_DataReq_t *req)
+{
+  (void)req;
+}
+
+/*****************************************************************************
+*****************************************************************************/
+static void benchDataConf(NWK_DataReq_t *req)
+{
+  (void)req;
+  benchConfirmed = true;
+}
+
+/*****************************************************************************
+*****************************************************************************/
+static void benchLoop(void)
+{
+  NWK_TaskHandler();
+  SYS_TimerTaskHandler();
+}
+
+/*****************************************************************************
+*****************************************************************************/
+static void benchSend(NWK_DataReq_t *req)
+{
+  NWK_DataReq(req);
+
+  while (!benchPhyTxPending)
+    benchLoop();
+
+  benchPhyConfirm(TRAC_STATUS_SUCCESS);
+}
+
+/*****************************************************************************
+*****************************************************************************/
+int main(void)
+{
+  double start, idle, request;
+
+  SYS_TimerInit();
+  NWK_Init();
+  NWK_SetAddr(1);
+  NWK_SetPanId(0x1234);
+
+  // Frames waiting for a NWK ACK occupy all buffers but two. The timer
+  // never advances, so they stay there for the whole run.
+  for (uint16_t i = 0; i < BENCH_PARKED; i++)
+  {
+    benchParkedReq[i].dstAddr = 0x0100 + i;
+    benchParkedReq[i].dstEndpoint = 1;
+    benchParkedReq[i].srcEndpoint = 1;
+    benchParkedReq[i].options = NWK_OPT_ACK_REQUEST;
+    benchParkedReq[i].data = benchData;
+    benchParkedReq[i].size = sizeof(benchData);
+    benchParkedReq[i].confirm = benchParkedConf;
+    benchSend(&benchParkedReq[i]);
+  }
+
+  for (uint8_t i = 0; i < 10; i++)
+    benchLoop();
+
+  start = benchTime();
+  for (uint32_t i = 0; i < BENCH_LOOPS; i++)
+    benchLoop();
+  idle = (benchTime() - start) / BENCH_LOOPS;
+
+  benchReq.dstAddr = 2;
+  benchReq.dstEndpoint = 1;
+  benchReq.srcEndpoint = 1;
+  benchReq.options = 0;
+  benchReq.data = benchData;
+  benchReq.size = sizeof(benchData);
+  benchReq.confirm = benchDataConf;
+
+  start = benchTime();
+  for (uint32_t i = 0; i < BENCH_REQUESTS; i++)
+  {
+    benchConfirmed = false;
+    benchSend(&benchReq);
+
+    while (!benchConfirmed)
+      benchLoop();
+  }
+  request = (benchTime() - start) / BENCH_REQUESTS;
+
+  printf("%8d %8d %12.1f %12.1f\n", NWK_BUFFERS_AMOUNT, BENCH_PARKED, idle, request);
+
+  return 0;
+}
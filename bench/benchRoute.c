@@ -0,0 +1,164 @@
+/**
+ * \file benchRoute.c
+ *
+ * \brief Route table lookup cost against a linear scan
+ *
+ * Copyright (C) 2012 Atmel Corporation. All rights reserved.
+ *
+ * \asf_license_start
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. The name of Atmel may not be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * 4. This software may only be redistributed and used in connection with an
+ *    Atmel microcontroller product.
+ *
+ * THIS SOFTWARE IS PROVIDED BY ATMEL "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT ARE
+ * EXPRESSLY AND SPECIFICALLY DISCLAIMED. IN NO EVENT SHALL ATMEL BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * \asf_license_stop
+ *
+ * $Id$
+ *
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "nwk.h"
+#include "nwkPrivate.h"
+#include "sysTimer.h"
+#include "benchStub.h"
+
+/*****************************************************************************
+*****************************************************************************/
+#define BENCH_LOOKUPS        2000000
+#define BENCH_ORDER_SIZE     4096 // must be a power of 2
+#define BENCH_NEIGHBOURS     8
+#define BENCH_FIRST_ADDR     0x0100
+
+/*****************************************************************************
+*****************************************************************************/
+// Record layout and search of the route table before it was hashed,
+// with a 16-bit index so that it covers the large tables as well
+typedef struct BenchLinearRecord_t
+{
+  uint16_t   dst;
+  uint16_t   nextHop;
+  uint8_t    score;
+  uint8_t    lqi;
+} BenchLinearRecord_t;
+
+/*****************************************************************************
+*****************************************************************************/
+static BenchLinearRecord_t benchLinearTable[NWK_ROUTE_TABLE_SIZE];
+static uint16_t benchOrder[BENCH_ORDER_SIZE];
+static volatile uint16_t benchSink;
+
+/*****************************************************************************
+*****************************************************************************/
+static __attribute__((noinline)) uint16_t benchLinearNextHop(uint16_t dst)
+{
+  for (uint16_t i = 0; i < NWK_ROUTE_TABLE_SIZE; i++)
+    if (benchLinearTable[i].dst == dst)
+      return benchLinearTable[i].nextHop;
+
+  return NWK_ROUTE_UNKNOWN;
+}
+
+/*****************************************************************************
+*****************************************************************************/
+static void benchFill(void)
+{
+  NwkFrame_t frame;
+  NwkFrameHeader_t *header = &frame.data.header;
+
+  memset(&frame, 0, sizeof(frame));
+  header->macDstPanId = 0x1234;
+  frame.rx.lqi = 0xff;
+
+  for (uint16_t i = 0; i < NWK_ROUTE_TABLE_SIZE; i++)
+  {
+    header->nwkSrcAddr = BENCH_FIRST_ADDR + i;
+    header->macSrcAddr = 1 + i % BENCH_NEIGHBOURS;
+    nwkRouteFrameReceived(&frame);
+
+    benchLinearTable[i].dst = header->nwkSrcAddr;
+    benchLinearTable[i].nextHop = header->macSrcAddr;
+    benchLinearTable[i].score = NWK_ROUTE_DEFAULT_SCORE;
+    benchLinearTable[i].lqi = frame.rx.lqi;
+  }
+}
+
+/*****************************************************************************
+*****************************************************************************/
+static double benchLookup(uint16_t (*nextHop)(uint16_t dst), uint16_t offset)
+{
+  double start = benchTime();
+
+  for (uint32_t i = 0; i < BENCH_LOOKUPS; i++)
+    benchSink = nextHop(benchOrder[i & (BENCH_ORDER_SIZE - 1)] + offset);
+
+  return (benchTime() - start) / BENCH_LOOKUPS;
+}
+
+/*****************************************************************************
+*****************************************************************************/
+int main(void)
+{
+  uint32_t seed = 1;
+  double linearHit, linearMiss, hashedHit, hashedMiss;
+
+  SYS_TimerInit();
+  NWK_Init();
+  NWK_SetAddr(0);
+  NWK_SetPanId(0x1234);
+
+  benchFill();
+
+  for (uint16_t i = 0; i < BENCH_ORDER_SIZE; i++)
+  {
+    seed = seed * 1103515245 + 12345;
+    benchOrder[i] = BENCH_FIRST_ADDR + (seed >> 16) % NWK_ROUTE_TABLE_SIZE;
+  }
+
+  for (uint16_t i = 0; i < NWK_ROUTE_TABLE_SIZE; i++)
+  {
+    if (NWK_RouteNextHop(BENCH_FIRST_ADDR + i) != benchLinearNextHop(BENCH_FIRST_ADDR + i))
+    {
+      printf("route to 0x%04x is missing\n", BENCH_FIRST_ADDR + i);
+      return 1;
+    }
+  }
+
+  // Misses look up addresses right above the ones in the table
+  linearHit = benchLookup(benchLinearNextHop, 0);
+  linearMiss = benchLookup(benchLinearNextHop, NWK_ROUTE_TABLE_SIZE);
+  hashedHit = benchLookup(NWK_RouteNextHop, 0);
+  hashedMiss = benchLookup(NWK_RouteNextHop, NWK_ROUTE_TABLE_SIZE);
+
+  printf("%8d %12.1f %12.1f %12.1f %12.1f\n", NWK_ROUTE_TABLE_SIZE,
+      linearHit, linearMiss, hashedHit, hashedMiss);
+
+  return 0;
+}
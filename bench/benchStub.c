@@ -0,0 +1,134 @@
+/**
+ * \file benchStub.c
+ *
+ * \brief Host stand-ins for the PHY and HAL used by the benchmarks
+ *
+ * Copyright (C) 2012 Atmel Corporation. All rights reserved.
+ *
+ * \asf_license_start
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. The name of Atmel may not be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * 4. This software may only be redistributed and used in connection with an
+ *    Atmel microcontroller product.
+ *
+ * THIS SOFTWARE IS PROVIDED BY ATMEL "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT ARE
+ * EXPRESSLY AND SPECIFICALLY DISCLAIMED. IN NO EVENT SHALL ATMEL BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * \asf_license_stop
+ *
+ * $Id$
+ *
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "phy.h"
+#include "halTimer.h"
+#include "benchStub.h"
+
+/*****************************************************************************
+*****************************************************************************/
+volatile uint8_t SREG;
+volatile uint8_t halTimerIrqCount;
+
+uint8_t benchPhyTxSize;
+bool benchPhyTxPending;
+
+/*****************************************************************************
+*****************************************************************************/
+void benchPhyConfirm(uint8_t status)
+{
+  benchPhyTxPending = false;
+  PHY_DataConf(status);
+}
+
+/*****************************************************************************
+*****************************************************************************/
+void PHY_Init(void)
+{
+}
+
+/*****************************************************************************
+*****************************************************************************/
+void PHY_SetRxState(bool rx)
+{
+  (void)rx;
+}
+
+/*****************************************************************************
+*****************************************************************************/
+void PHY_SetChannel(uint8_t channel)
+{
+  (void)channel;
+}
+
+/*****************************************************************************
+*****************************************************************************/
+void PHY_SetPanId(uint16_t panId)
+{
+  (void)panId;
+}
+
+/*****************************************************************************
+*****************************************************************************/
+void PHY_SetShortAddr(uint16_t addr)
+{
+  (void)addr;
+}
+
+/*****************************************************************************
+*****************************************************************************/
+bool PHY_Busy(void)
+{
+  return benchPhyTxPending;
+}
+
+/*****************************************************************************
+*****************************************************************************/
+void PHY_Sleep(void)
+{
+}
+
+/*****************************************************************************
+*****************************************************************************/
+void PHY_Wakeup(void)
+{
+}
+
+/*****************************************************************************
+*****************************************************************************/
+void PHY_DataReq(uint8_t *data, uint8_t size)
+{
+  (void)data;
+  benchPhyTxSize = size;
+  benchPhyTxPending = true;
+}
+
+#ifdef PHY_ENABLE_RANDOM_NUMBER_GENERATOR
+/*****************************************************************************
+*****************************************************************************/
+void PHY_RandomReq(void)
+{
+}
+#endif
@@ -0,0 +1,65 @@
+/**
+ * \file config.h
+ *
+ * \brief Stack configuration for the host benchmarks
+ *
+ * Copyright (C) 2012 Atmel Corporation. All rights reserved.
+ *
+ * \asf_license_start
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. The name of Atmel may not be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * 4. This software may only be redistributed and used in connection with an
+ *    Atmel microcontroller product.
+ *
+ * THIS SOFTWARE IS PROVIDED BY ATMEL "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT ARE
+ * EXPRESSLY AND SPECIFICALLY DISCLAIMED. IN NO EVENT SHALL ATMEL BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * \asf_license_stop
+ *
+ * $Id$
+ *
+ */
+
+#ifndef _CONFIG_H_
+#define _CONFIG_H_
+
+/*****************************************************************************
+*****************************************************************************/
+// Router configuration. The benchmark Makefile overrides the table sizes.
+#ifndef NWK_BUFFERS_AMOUNT
+#define NWK_BUFFERS_AMOUNT                  20
+#endif
+#define NWK_SMALL_BUFFERS_AMOUNT            4
+#define NWK_MAX_ENDPOINTS_AMOUNT            3
+#define NWK_DUPLICATE_REJECTION_TABLE_SIZE  10
+#define NWK_DUPLICATE_REJECTION_TTL         1000 // ms
+#ifndef NWK_ROUTE_TABLE_SIZE
+#define NWK_ROUTE_TABLE_SIZE                100
+#endif
+#define NWK_ROUTE_DEFAULT_SCORE             3
+#define NWK_ACK_WAIT_TIME                   1000 // ms
+
+#define NWK_ENABLE_ROUTING
+
+#endif // _CONFIG_H_
@@ -0,0 +1,81 @@
+/**
+ * \file halEeprom.c
+ *
+ * \brief ATmega128rfa1 EEPROM implementation
+ *
+ * Copyright (C) 2012 Atmel Corporation. All rights reserved.
+ *
+ * \asf_license_start
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. The name of Atmel may not be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * 4. This software may only be redistributed and used in connection with an
+ *    Atmel microcontroller product.
+ *
+ * THIS SOFTWARE IS PROVIDED BY ATMEL "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT ARE
+ * EXPRESSLY AND SPECIFICALLY DISCLAIMED. IN NO EVENT SHALL ATMEL BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * \asf_license_stop
+ *
+ * $Id$
+ *
+ */
+
+#include <stdbool.h>
+#include "hal.h"
+#include "halEeprom.h"
+
+/*****************************************************************************
+*****************************************************************************/
+bool HAL_EepromReady(void)
+{
+  return 0 == (EECR & (1 << EEPE));
+}
+
+/*****************************************************************************
+*****************************************************************************/
+uint8_t HAL_EepromReadByte(uint16_t addr)
+{
+  while (EECR & (1 << EEPE));
+
+  EEAR = addr;
+  EECR |= (1 << EERE);
+
+  return EEDR;
+}
+
+/*****************************************************************************
+*****************************************************************************/
+void HAL_EepromWriteByte(uint16_t addr, uint8_t byte)
+{
+  while (EECR & (1 << EEPE));
+
+  EEAR = addr;
+  EEDR = byte;
+
+  // EEPE must be set within four cycles after EEMPE
+  ATOMIC_SECTION_ENTER
+    EECR |= (1 << EEMPE);
+    EECR |= (1 << EEPE);
+  ATOMIC_SECTION_LEAVE
+}
@@ -0,0 +1,111 @@
+/**
+ * \file halEeprom.c
+ *
+ * \brief ATxmega128b1 EEPROM implementation
+ *
+ * Copyright (C) 2012 Atmel Corporation. All rights reserved.
+ *
+ * \asf_license_start
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. The name of Atmel may not be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * 4. This software may only be redistributed and used in connection with an
+ *    Atmel microcontroller product.
+ *
+ * THIS SOFTWARE IS PROVIDED BY ATMEL "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT ARE
+ * EXPRESSLY AND SPECIFICALLY DISCLAIMED. IN NO EVENT SHALL ATMEL BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * \asf_license_stop
+ *
+ * $Id$
+ *
+ */
+
+#include <stdbool.h>
+#include "hal.h"
+#include "halEeprom.h"
+
+/*****************************************************************************
+*****************************************************************************/
+#define CONFIGURATION_CHANGE_PROTECTION  do { CCP = 0xd8; } while (0)
+
+/*****************************************************************************
+*****************************************************************************/
+static void halEepromExecute(uint8_t cmd)
+{
+  NVM.CMD = cmd;
+
+  ATOMIC_SECTION_ENTER
+    CONFIGURATION_CHANGE_PROTECTION;
+    NVM.CTRLA = NVM_CMDEX_bm;
+  ATOMIC_SECTION_LEAVE
+}
+
+/*****************************************************************************
+*****************************************************************************/
+static void halEepromSetAddr(uint16_t addr)
+{
+  NVM.ADDR0 = addr & 0xff;
+  NVM.ADDR1 = addr >> 8;
+  NVM.ADDR2 = 0;
+}
+
+/*****************************************************************************
+*****************************************************************************/
+bool HAL_EepromReady(void)
+{
+  return 0 == (NVM.STATUS & NVM_NVMBUSY_bm);
+}
+
+/*****************************************************************************
+*****************************************************************************/
+uint8_t HAL_EepromReadByte(uint16_t addr)
+{
+  while (NVM.STATUS & NVM_NVMBUSY_bm);
+
+  halEepromSetAddr(addr);
+  halEepromExecute(NVM_CMD_READ_EEPROM_gc);
+
+  return NVM.DATA0;
+}
+
+/*****************************************************************************
+*****************************************************************************/
+void HAL_EepromWriteByte(uint16_t addr, uint8_t byte)
+{
+  while (NVM.STATUS & NVM_NVMBUSY_bm);
+
+  if (NVM.STATUS & NVM_EELOAD_bm)
+  {
+    halEepromExecute(NVM_CMD_ERASE_EEPROM_BUFFER_gc);
+    while (NVM.STATUS & NVM_NVMBUSY_bm);
+  }
+
+  // Only the loaded location of the page is erased and written
+  NVM.CMD = NVM_CMD_LOAD_EEPROM_BUFFER_gc;
+  halEepromSetAddr(addr);
+  NVM.DATA0 = byte;
+
+  halEepromSetAddr(addr);
+  halEepromExecute(NVM_CMD_ERASE_WRITE_EEPROM_PAGE_gc);
+}
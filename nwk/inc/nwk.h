@@ -62,6 +62,7 @@ typedef enum
   NWK_OUT_OF_MEMORY_STATUS                = 0x02,
 
   NWK_NO_ACK_STATUS                       = 0x10,
+  NWK_NO_ROUTE_STATUS                     = 0x11,
 
   NWK_PHY_CHANNEL_ACCESS_FAILURE_STATUS   = 0x20,
   NWK_PHY_NO_ACK_STATUS                   = 0x21,
@@ -73,6 +74,27 @@ enum
   NWK_OPT_ENABLE_SECURITY      = 1 << 1,
   NWK_OPT_BROADCAST_PAN_ID     = 1 << 2,
   NWK_OPT_LINK_LOCAL           = 1 << 3,
+  NWK_OPT_PRIORITY_HIGH        = 1 << 4,
+  NWK_OPT_PRIORITY_LOW         = 1 << 5,
+  NWK_OPT_MULTICAST            = 1 << 6,
+};
+
+// Transmit traffic classes, in the order of decreasing priority. Data
+// requests go to NWK_TX_CLASS_DATA, NWK_OPT_PRIORITY_HIGH moves them to
+// NWK_TX_CLASS_FORWARDED and NWK_OPT_PRIORITY_LOW to NWK_TX_CLASS_BROADCAST.
+enum
+{
+  NWK_TX_CLASS_COMMAND         = 0,
+  NWK_TX_CLASS_FORWARDED       = 1,
+  NWK_TX_CLASS_DATA            = 2,
+  NWK_TX_CLASS_BROADCAST       = 3,
+  NWK_TX_CLASSES_AMOUNT,
+};
+
+enum
+{
+  NWK_RETRIES_DEFAULT          = 0x00,
+  NWK_RETRIES_NONE             = 0xff,
 };
 
 enum
@@ -83,6 +105,7 @@ enum
   NWK_IND_OPT_LOCAL             = 1 << 3,
   NWK_IND_OPT_BROADCAST_PAN_ID  = 1 << 4,
   NWK_IND_OPT_LINK_LOCAL        = 1 << 5,
+  NWK_IND_OPT_MULTICAST         = 1 << 6,
 };
 
 enum
@@ -106,6 +129,7 @@ typedef struct NWK_DataReq_t
 
   uint8_t      *data;
   uint8_t      size;
+  uint8_t      retries; // Must be set, NWK_RETRIES_DEFAULT selects NWK_ACK_RETRIES
 
   void         (*confirm)(struct NWK_DataReq_t *req);
 
@@ -126,6 +150,34 @@ typedef struct NWK_DataInd_t
   int8_t       rssi;
 } NWK_DataInd_t;
 
+#ifdef NWK_ENABLE_STATISTICS
+typedef struct NWK_TxClassStats_t
+{
+  uint8_t      depth;
+  uint8_t      maxDepth;
+  uint16_t     sent;
+  uint16_t     maxWait;   // ms
+  uint32_t     totalWait; // ms
+} NWK_TxClassStats_t;
+
+typedef struct NWK_DuplicateStats_t
+{
+  uint16_t     rejected;
+  uint16_t     evicted;
+} NWK_DuplicateStats_t;
+
+#ifdef NWK_ENABLE_SECURITY
+typedef struct NWK_SecurityStats_t
+{
+  uint16_t     decrypted;
+  uint16_t     noEndpoint;  // Dropped before decryption
+  uint16_t     duplicate;   // Dropped before decryption
+  uint16_t     pressure;    // Dropped before decryption
+  uint32_t     savedBlocks; // AES blocks not spent on dropped frames
+} NWK_SecurityStats_t;
+#endif
+#endif
+
 /*****************************************************************************
 *****************************************************************************/
 void NWK_Init(void);
@@ -135,10 +187,31 @@ void NWK_OpenEndpoint(uint8_t id, bool (*handler)(NWK_DataInd_t *ind));
 #ifdef NWK_ENABLE_SECURITY
 void NWK_SetSecurityKey(uint8_t *key);
 #endif
+#if NWK_LINK_KEY_TABLE_SIZE > 0
+// Secured unicast frames exchanged with a peer that has a link key use that
+// key instead of the network key, broadcast and group frames never do
+bool NWK_SetLinkKey(uint16_t addr, uint8_t *key);
+bool NWK_RemoveLinkKey(uint16_t addr);
+#endif
 bool NWK_Busy(void);
 void NWK_SleepReq(void);
 void NWK_WakeupReq(void);
+// Data requests are serviced in the order they were submitted, and frames
+// are handed to the transmitter in that order. Confirmations are delivered
+// in the order transmissions complete, so requests to different destinations
+// or with different options may be confirmed out of order. A request must
+// not be modified or resubmitted until its confirm callback is called.
+// All request parameters are read, including retries, so a request that is
+// not static must be cleared or fully initialized before it is submitted.
 void NWK_DataReq(NWK_DataReq_t *req);
+// The request dstAddr, options and size must be set before the reservation.
+// A request that no longer fits the reserved frame when it is committed is
+// confirmed with NWK_OUT_OF_MEMORY_STATUS. Every reservation must end with
+// either NWK_DataReqCommit() or NWK_DataReqRelease(), the frame is not
+// returned to the pool otherwise. A released request is not confirmed.
+uint8_t *NWK_DataReqReserve(NWK_DataReq_t *req);
+void NWK_DataReqCommit(NWK_DataReq_t *req);
+void NWK_DataReqRelease(NWK_DataReq_t *req);
 void NWK_SetAckControl(uint8_t control);
 void NWK_TaskHandler(void);
 
@@ -146,5 +219,21 @@ void NWK_TaskHandler(void);
 uint16_t NWK_RouteNextHop(uint16_t dst);
 #endif
 
+#ifdef NWK_ENABLE_MULTICAST
+// With NWK_OPT_MULTICAST the request dstAddr is a group ID. Group frames
+// are flooded through the network and indicated only on the group members.
+bool NWK_GroupAdd(uint16_t group);
+bool NWK_GroupRemove(uint16_t group);
+bool NWK_GroupIsMember(uint16_t group);
+#endif
+
+#ifdef NWK_ENABLE_STATISTICS
+void NWK_GetTxClassStats(uint8_t txClass, NWK_TxClassStats_t *stats);
+void NWK_GetDuplicateStats(NWK_DuplicateStats_t *stats);
+#ifdef NWK_ENABLE_SECURITY
+void NWK_GetSecurityStats(NWK_SecurityStats_t *stats);
+#endif
+#endif
+
 #endif // _NWK_H_
 
@@ -54,18 +54,31 @@
 #define NWK_SECURITY_KEY_SIZE    16
 #define NWK_SECURITY_BLOCK_SIZE  16
 
+#define NWK_ROUTE_UNKNOWN           0xffff
+
+// Expected transmission count in 1/16 units
+#define NWK_ROUTE_ETX_ONE           16
+#define NWK_ROUTE_ETX_FAILURE       (8 * NWK_ROUTE_ETX_ONE)
+#define NWK_ROUTE_ETX_UNKNOWN       NWK_ROUTE_ETX_FAILURE
+#define NWK_ROUTE_ETX_HYSTERESIS    NWK_ROUTE_ETX_ONE
+
 /*****************************************************************************
 *****************************************************************************/
 enum
 {
-  NWK_COMMAND_ACK              = 0x00,
-  NWK_COMMAND_ROUTE_ERROR      = 0x01,
+  NWK_COMMAND_ACK               = 0x00,
+  NWK_COMMAND_ROUTE_ERROR       = 0x01,
+  NWK_COMMAND_ROUTE_REQUEST     = 0x02,
+  NWK_COMMAND_ROUTE_REPLY       = 0x03,
+  NWK_COMMAND_ROUTE_RECORD      = 0x04,
+  NWK_COMMAND_COLLECTION_BEACON = 0x05,
 };
 
 enum
 {
   NWK_TX_CONTROL_BROADCAST_PAN_ID = 1 << 0,
   NWK_TX_CONTROL_ROUTING          = 1 << 1,
+  NWK_TX_CONTROL_REROUTED         = 1 << 2,
 };
 
 /*****************************************************************************
@@ -83,7 +96,10 @@ typedef struct PACK NwkFrameHeader_t
     uint8_t   ackRequest       : 1;
     uint8_t   securityEnabled  : 1;
     uint8_t   linkLocal        : 1;
-    uint8_t   reserved         : 5;
+    uint8_t   multicast        : 1;
+    uint8_t   sourceRoute      : 1;
+    uint8_t   retry            : 2;
+    uint8_t   collection       : 1;
   }           nwkFcf;
   uint8_t     nwkSeq;
   uint16_t    nwkSrcAddr;
@@ -97,13 +113,9 @@ typedef struct PACK NwkFrameHeader_t
 
 typedef struct NwkFrame_t
 {
+  struct NwkFrame_t  *next;
   uint8_t            state;
   uint8_t            size;
-  struct PACK
-  {
-    NwkFrameHeader_t header;
-    uint8_t          payload[NWK_MAX_PAYLOAD_SIZE];
-  } data;
 
   union
   {
@@ -116,13 +128,39 @@ typedef struct NwkFrame_t
     struct
     {
       uint8_t        status;
-      uint16_t       timeout;
+      uint16_t       deadline; // ms
+      struct NwkFrame_t *prev;
+      struct NwkFrame_t *hashNext;
       uint8_t        control;
       void           (*confirm)(struct NwkFrame_t *frame);
+      NWK_DataReq_t  *req;
+      uint8_t        trafficClass;
+      uint8_t        retries;
+      uint8_t        attempts;
+#if NWK_ACK_RTT_TABLE_SIZE > 0
+      uint16_t       sentTime;
+#endif
+#ifdef NWK_ENABLE_STATISTICS
+      uint16_t       queueTime;
+#endif
     } tx;
   };
+
+  // Must be the last field, small buffers are allocated without the tail
+  // of the payload
+  struct PACK
+  {
+    NwkFrameHeader_t header;
+    uint8_t          payload[NWK_MAX_PAYLOAD_SIZE];
+  } data;
 } NwkFrame_t;
 
+typedef struct NwkFrameQueue_t
+{
+  NwkFrame_t   *head;
+  NwkFrame_t   *tail;
+} NwkFrameQueue_t;
+
 typedef struct PACK NwkAckCommand_t
 {
   uint8_t    id;
@@ -137,6 +175,47 @@ typedef struct PACK NwkRouteErrorCommand_t
   uint16_t   dstAddr;
 } NwkRouteErrorCommand_t;
 
+typedef struct PACK NwkRouteDiscoveryCommand_t
+{
+  uint8_t    id;
+  uint16_t   srcAddr;
+  uint16_t   dstAddr;
+} NwkRouteDiscoveryCommand_t;
+
+// Follows the header of source routed frames, lists the relays from the
+// originator towards the destination
+typedef struct PACK NwkSourceRouteHeader_t
+{
+  uint8_t    hops;
+  uint16_t   relay[NWK_SOURCE_ROUTE_MAX_HOPS];
+} NwkSourceRouteHeader_t;
+
+// Relays on the way to the coordinator fill in the list
+typedef struct PACK NwkRouteRecordCommand_t
+{
+  uint8_t    id;
+  uint8_t    hops;
+  uint16_t   relay[NWK_SOURCE_ROUTE_MAX_HOPS];
+} NwkRouteRecordCommand_t;
+
+typedef struct PACK NwkCollectionBeaconCommand_t
+{
+  uint8_t    id;
+  uint16_t   pathEtx;
+} NwkCollectionBeaconCommand_t;
+
+typedef struct PACK NwkRouteStoreRoute_t
+{
+  uint16_t   dst;
+  uint16_t   nextHop;
+} NwkRouteStoreRoute_t;
+
+typedef struct PACK NwkRouteStoreNeighbour_t
+{
+  uint16_t   addr;
+  uint8_t    etx;
+} NwkRouteStoreNeighbour_t;
+
 typedef struct NwkIb_t
 {
   uint16_t     addr;
@@ -158,8 +237,14 @@ extern NwkIb_t nwkIb;
 void nwkFrameInit(void);
 NwkFrame_t *nwkFrameAlloc(uint8_t size);
 void nwkFrameFree(NwkFrame_t *frame);
-NwkFrame_t *nwkFrameByIndex(uint8_t i);
+uint8_t nwkFrameCapacity(NwkFrame_t *frame);
+bool nwkFramePoolExhausted(void);
 void nwkFrameCommandInit(NwkFrame_t *frame);
+uint8_t nwkFrameHeaderSize(NwkFrame_t *frame);
+
+void nwkFrameQueueInit(NwkFrameQueue_t *queue);
+void nwkFrameQueuePush(NwkFrameQueue_t *queue, NwkFrame_t *frame);
+NwkFrame_t *nwkFrameQueuePop(NwkFrameQueue_t *queue);
 
 void nwkRxInit(void);
 bool nwkRxBusy(void);
@@ -172,6 +257,8 @@ void nwkTxBroadcastFrame(NwkFrame_t *frame);
 void nwkTxAckReceived(NWK_DataInd_t *ind);
 bool nwkTxBusy(void);
 void nwkTxEncryptConf(NwkFrame_t *frame);
+void nwkTxDecryptConf(NwkFrame_t *frame);
+void nwkTxRouteDiscoveryConf(NwkFrame_t *frame, bool found);
 void nwkTxTaskHandler(void);
 
 void nwkDataReqInit(void);
@@ -183,15 +270,67 @@ void nwkRouteInit(void);
 void nwkRouteRemove(uint16_t dst);
 void nwkRouteFrameReceived(NwkFrame_t *frame);
 void nwkRouteFrameSent(NwkFrame_t *frame);
+void nwkRouteLinkUpdate(uint16_t addr, bool success);
+uint16_t nwkRouteLinkEtx(uint16_t addr);
 uint16_t nwkRouteNextHop(uint16_t dst);
 void nwkRouteFrame(NwkFrame_t *frame);
 void nwkRouteErrorReceived(NWK_DataInd_t *ind);
 #endif
 
+#ifdef NWK_ENABLE_ROUTE_STORE
+void nwkRouteExport(uint16_t index, NwkRouteStoreRoute_t *route);
+void nwkRouteImport(NwkRouteStoreRoute_t *route);
+void nwkRouteNeighbourExport(uint8_t index, NwkRouteStoreNeighbour_t *neighbour);
+void nwkRouteNeighbourImport(NwkRouteStoreNeighbour_t *neighbour);
+
+void nwkRouteStoreInit(void);
+void nwkRouteStoreTaskHandler(void);
+#endif
+
+#ifdef NWK_ENABLE_ROUTE_DISCOVERY
+void nwkRouteDiscoveryInit(void);
+bool nwkRouteDiscoveryRequest(NwkFrame_t *frame);
+void nwkRouteDiscoveryRequestReceived(NWK_DataInd_t *ind);
+void nwkRouteDiscoveryReplyReceived(NWK_DataInd_t *ind);
+#endif
+
+#ifdef NWK_ENABLE_SOURCE_ROUTING
+void nwkSourceRouteInit(void);
+bool nwkSourceRouteFrameCheck(NwkFrame_t *frame);
+uint16_t nwkSourceRouteNextHop(NwkFrame_t *frame);
+void nwkSourceRouteRecordForward(NwkFrame_t *frame);
+void nwkSourceRouteRecordUpdate(uint16_t dst);
+#endif
+
+#if NWK_SOURCE_ROUTE_TABLE_SIZE > 0
+uint8_t nwkSourceRouteSize(uint16_t dst);
+void nwkSourceRouteBuild(NwkFrame_t *frame, uint16_t dst);
+void nwkSourceRouteStrip(NwkFrame_t *frame);
+void nwkSourceRouteRemove(uint16_t dst);
+void nwkSourceRouteRecordReceived(NWK_DataInd_t *ind);
+#endif
+
+#ifdef NWK_ENABLE_COLLECTION
+void nwkCollectionInit(void);
+uint16_t nwkCollectionNextHop(void);
+void nwkCollectionParentLost(void);
+bool nwkCollectionFrameSent(NwkFrame_t *frame);
+void nwkCollectionBeaconReceived(NWK_DataInd_t *ind);
+#endif
+
+#ifdef NWK_ENABLE_MULTICAST
+void nwkGroupInit(void);
+#endif
+
 #ifdef NWK_ENABLE_SECURITY
 void nwkSecurityInit(void);
 void nwkSecurityProcess(NwkFrame_t *frame, bool encrypt);
 void nwkSecurityTaskHandler(void);
 #endif
 
+#if NWK_LINK_KEY_TABLE_SIZE > 0
+void nwkLinkKeyInit(void);
+uint8_t *nwkLinkKeyGet(uint16_t addr);
+#endif
+
 #endif // _NWK_PRIVATE_H_
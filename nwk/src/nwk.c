@@ -72,9 +72,29 @@ void NWK_Init(void)
   nwkRouteInit();
 #endif
 
+#ifdef NWK_ENABLE_ROUTE_DISCOVERY
+  nwkRouteDiscoveryInit();
+#endif
+
+#ifdef NWK_ENABLE_SOURCE_ROUTING
+  nwkSourceRouteInit();
+#endif
+
+#ifdef NWK_ENABLE_COLLECTION
+  nwkCollectionInit();
+#endif
+
+#ifdef NWK_ENABLE_MULTICAST
+  nwkGroupInit();
+#endif
+
 #ifdef NWK_ENABLE_SECURITY
   nwkSecurityInit();
 #endif
+
+#if NWK_LINK_KEY_TABLE_SIZE > 0
+  nwkLinkKeyInit();
+#endif
 }
 
 /*****************************************************************************
@@ -140,4 +160,7 @@ void NWK_TaskHandler(void)
 #ifdef NWK_ENABLE_SECURITY
   nwkSecurityTaskHandler();
 #endif
+#ifdef NWK_ENABLE_ROUTE_STORE
+  nwkRouteStoreTaskHandler();
+#endif
 }
@@ -0,0 +1,260 @@
+/**
+ * \file nwkCollection.c
+ *
+ * \brief Collection tree routing implementation
+ *
+ * Copyright (C) 2012 Atmel Corporation. All rights reserved.
+ *
+ * \asf_license_start
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. The name of Atmel may not be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * 4. This software may only be redistributed and used in connection with an
+ *    Atmel microcontroller product.
+ *
+ * THIS SOFTWARE IS PROVIDED BY ATMEL "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT ARE
+ * EXPRESSLY AND SPECIFICALLY DISCLAIMED. IN NO EVENT SHALL ATMEL BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * \asf_license_stop
+ *
+ * $Id$
+ *
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "nwk.h"
+#include "nwkPrivate.h"
+#include "sysTimer.h"
+
+#ifdef NWK_ENABLE_COLLECTION
+
+/*****************************************************************************
+*****************************************************************************/
+#define NWK_COLLECTION_BEACON_JITTER   (NWK_COLLECTION_BEACON_INTERVAL / 4)
+
+/*****************************************************************************
+*****************************************************************************/
+typedef struct NwkCollectionParent_t
+{
+  uint16_t   addr;
+  uint16_t   pathEtx; // advertised by the parent
+} NwkCollectionParent_t;
+
+/*****************************************************************************
+*****************************************************************************/
+static void nwkCollectionBeaconTimerHandler(SYS_Timer_t *timer);
+static void nwkCollectionBeaconConf(NwkFrame_t *frame);
+
+/*****************************************************************************
+*****************************************************************************/
+static NwkCollectionParent_t nwkCollectionParent;
+static NwkCollectionParent_t nwkCollectionBackup;
+static uint8_t nwkCollectionScore;
+static SYS_Timer_t nwkCollectionBeaconTimer;
+
+/*****************************************************************************
+*****************************************************************************/
+static void nwkCollectionBeaconTimerStart(void)
+{
+  // Jitter keeps the beacons of neighbours from colliding every interval
+  nwkCollectionBeaconTimer.interval = NWK_COLLECTION_BEACON_INTERVAL -
+      NWK_COLLECTION_BEACON_JITTER / 2 + (uint32_t)rand() % (NWK_COLLECTION_BEACON_JITTER + 1);
+  SYS_TimerStart(&nwkCollectionBeaconTimer);
+}
+
+/*****************************************************************************
+*****************************************************************************/
+void nwkCollectionInit(void)
+{
+  nwkCollectionParent.addr = NWK_ROUTE_UNKNOWN;
+  nwkCollectionBackup.addr = NWK_ROUTE_UNKNOWN;
+  nwkCollectionScore = NWK_ROUTE_DEFAULT_SCORE;
+
+  nwkCollectionBeaconTimer.mode = SYS_TIMER_INTERVAL_MODE;
+  nwkCollectionBeaconTimer.handler = nwkCollectionBeaconTimerHandler;
+  nwkCollectionBeaconTimerStart();
+}
+
+/*****************************************************************************
+*****************************************************************************/
+static uint16_t nwkCollectionCost(NwkCollectionParent_t *parent)
+{
+  uint32_t cost;
+
+  if (NWK_ROUTE_UNKNOWN == parent->addr || NWK_ROUTE_UNKNOWN == parent->pathEtx)
+    return NWK_ROUTE_UNKNOWN;
+
+  cost = (uint32_t)parent->pathEtx + nwkRouteLinkEtx(parent->addr);
+
+  return (cost < NWK_ROUTE_UNKNOWN) ? cost : NWK_ROUTE_UNKNOWN - 1;
+}
+
+/*****************************************************************************
+*****************************************************************************/
+static uint16_t nwkCollectionPathEtx(void)
+{
+  if (NWK_COLLECTION_SINK_ADDR == nwkIb.addr)
+    return 0;
+
+  return nwkCollectionCost(&nwkCollectionParent);
+}
+
+/*****************************************************************************
+*****************************************************************************/
+uint16_t nwkCollectionNextHop(void)
+{
+  return nwkCollectionParent.addr;
+}
+
+/*****************************************************************************
+*****************************************************************************/
+void nwkCollectionParentLost(void)
+{
+  if (NWK_ROUTE_UNKNOWN != nwkCollectionCost(&nwkCollectionBackup))
+    nwkCollectionParent = nwkCollectionBackup;
+  else
+    nwkCollectionParent.addr = NWK_ROUTE_UNKNOWN;
+
+  nwkCollectionBackup.addr = NWK_ROUTE_UNKNOWN;
+  nwkCollectionScore = NWK_ROUTE_DEFAULT_SCORE;
+}
+
+/*****************************************************************************
+*****************************************************************************/
+bool nwkCollectionFrameSent(NwkFrame_t *frame)
+{
+  if (NWK_ROUTE_UNKNOWN == nwkCollectionParent.addr ||
+      frame->data.header.macDstAddr != nwkCollectionParent.addr)
+    return false;
+
+  // Consecutive failures fail over to the backup parent, if there is one
+  if (NWK_SUCCESS_STATUS == frame->tx.status)
+  {
+    nwkCollectionScore = NWK_ROUTE_DEFAULT_SCORE;
+  }
+  else
+  {
+    nwkCollectionScore--;
+    if (0 == nwkCollectionScore)
+      nwkCollectionParentLost();
+  }
+
+  return true;
+}
+
+/*****************************************************************************
+*****************************************************************************/
+void nwkCollectionBeaconReceived(NWK_DataInd_t *ind)
+{
+  NwkCollectionBeaconCommand_t *command = (NwkCollectionBeaconCommand_t *)ind->data;
+  NwkCollectionParent_t candidate;
+  uint16_t cost;
+
+  if (sizeof(NwkCollectionBeaconCommand_t) != ind->size ||
+      NWK_COLLECTION_SINK_ADDR == nwkIb.addr)
+    return;
+
+  candidate.addr = ind->srcAddr;
+  candidate.pathEtx = command->pathEtx;
+
+  if (candidate.addr == nwkCollectionBackup.addr)
+    nwkCollectionBackup.pathEtx = candidate.pathEtx;
+
+  if (candidate.addr == nwkCollectionParent.addr)
+  {
+    nwkCollectionParent.pathEtx = candidate.pathEtx;
+
+    // The parent has no path to the sink any more
+    if (NWK_ROUTE_UNKNOWN == candidate.pathEtx)
+      nwkCollectionParentLost();
+    return;
+  }
+
+  // A neighbour that is not closer to the sink than this node may be one
+  // of its children, selecting it would make a loop
+  if (candidate.pathEtx >= nwkCollectionPathEtx())
+    return;
+
+  cost = nwkCollectionCost(&candidate);
+  if (NWK_ROUTE_UNKNOWN == cost)
+    return;
+
+  // The hysteresis keeps the parent from flapping between neighbours of
+  // similar quality
+  if ((uint32_t)cost + NWK_ROUTE_ETX_HYSTERESIS < nwkCollectionCost(&nwkCollectionParent))
+  {
+    if (NWK_ROUTE_UNKNOWN != nwkCollectionParent.addr)
+      nwkCollectionBackup = nwkCollectionParent;
+    else if (candidate.addr == nwkCollectionBackup.addr)
+      nwkCollectionBackup.addr = NWK_ROUTE_UNKNOWN;
+
+    nwkCollectionParent = candidate;
+    nwkCollectionScore = NWK_ROUTE_DEFAULT_SCORE;
+  }
+  else if (cost < nwkCollectionCost(&nwkCollectionBackup))
+  {
+    nwkCollectionBackup = candidate;
+  }
+}
+
+/*****************************************************************************
+*****************************************************************************/
+static void nwkCollectionBeaconTimerHandler(SYS_Timer_t *timer)
+{
+  NwkFrame_t *frame;
+  NwkCollectionBeaconCommand_t *command;
+
+  nwkCollectionBeaconTimerStart();
+
+  if (NULL == (frame = nwkFrameAlloc(sizeof(NwkCollectionBeaconCommand_t))))
+    return;
+
+  nwkFrameCommandInit(frame);
+
+  frame->tx.confirm = nwkCollectionBeaconConf;
+
+  frame->data.header.nwkFcf.linkLocal = 1;
+  frame->data.header.nwkDstAddr = 0xffff;
+
+  command = (NwkCollectionBeaconCommand_t *)frame->data.payload;
+
+  // Nodes without a parent advertise an unknown cost, so their children
+  // drop them instead of waiting for failures
+  command->id = NWK_COMMAND_COLLECTION_BEACON;
+  command->pathEtx = nwkCollectionPathEtx();
+
+  nwkTxFrame(frame);
+
+  (void)timer;
+}
+
+/*****************************************************************************
+*****************************************************************************/
+static void nwkCollectionBeaconConf(NwkFrame_t *frame)
+{
+  nwkFrameFree(frame);
+}
+
+#endif // NWK_ENABLE_COLLECTION
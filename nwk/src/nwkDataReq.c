@@ -62,40 +62,55 @@ static void nwkDataReqTxConf(NwkFrame_t *frame);
 
 /*****************************************************************************
 *****************************************************************************/
-static NWK_DataReq_t *nwkDataReqQueue;
+static NWK_DataReq_t *nwkDataReqSubmitHead;
+static NWK_DataReq_t *nwkDataReqSubmitTail;
+static NWK_DataReq_t *nwkDataReqConfirmHead;
+static NWK_DataReq_t *nwkDataReqConfirmTail;
 
 /*****************************************************************************
 *****************************************************************************/
 void nwkDataReqInit(void)
 {
-  nwkDataReqQueue = NULL;
+  nwkDataReqSubmitHead = NULL;
+  nwkDataReqSubmitTail = NULL;
+  nwkDataReqConfirmHead = NULL;
+  nwkDataReqConfirmTail = NULL;
 }
 
 /*****************************************************************************
 *****************************************************************************/
-void NWK_DataReq(NWK_DataReq_t *req)
+static void nwkDataReqPush(NWK_DataReq_t **head, NWK_DataReq_t **tail, NWK_DataReq_t *req)
 {
-  req->state = NWK_DATA_REQ_STATE_INITIAL;
-  req->status = NWK_SUCCESS_STATUS;
-  req->frame = NULL;
+  req->next = NULL;
 
-  if (NULL == nwkDataReqQueue)
-  {
-    req->next = NULL;
-    nwkDataReqQueue = req;
-  }
+  if (*tail)
+    (*tail)->next = req;
   else
+    *head = req;
+
+  *tail = req;
+}
+
+/*****************************************************************************
+*****************************************************************************/
+static NWK_DataReq_t *nwkDataReqPop(NWK_DataReq_t **head, NWK_DataReq_t **tail)
+{
+  NWK_DataReq_t *req = *head;
+
+  if (req)
   {
-    req->next = nwkDataReqQueue;
-    nwkDataReqQueue = req;
+    *head = req->next;
+    if (NULL == *head)
+      *tail = NULL;
   }
+
+  return req;
 }
 
 /*****************************************************************************
 *****************************************************************************/
-static void nwkDataReqSendFrame(NWK_DataReq_t *req)
+static uint8_t nwkDataReqFrameSize(NWK_DataReq_t *req)
 {
-  NwkFrame_t *frame;
   uint8_t size = req->size;
 
 #ifdef NWK_ENABLE_SECURITY
@@ -103,10 +118,131 @@ static void nwkDataReqSendFrame(NWK_DataReq_t *req)
     size += NWK_SECURITY_MIC_SIZE;
 #endif
 
-  if (NULL == (frame = nwkFrameAlloc(size)))
+  return size;
+}
+
+/*****************************************************************************
+*****************************************************************************/
+static NwkFrame_t *nwkDataReqFrameAlloc(NWK_DataReq_t *req)
+{
+  NwkFrame_t *frame;
+  uint8_t size = nwkDataReqFrameSize(req);
+  uint8_t route = 0;
+
+#if NWK_SOURCE_ROUTE_TABLE_SIZE > 0
+  // Frames that do not fit with the relay list are routed by the table
+  if (0 == (req->options & (NWK_OPT_MULTICAST | NWK_OPT_LINK_LOCAL)))
+    route = nwkSourceRouteSize(req->dstAddr);
+  if (route + size > NWK_MAX_PAYLOAD_SIZE)
+    route = 0;
+#endif
+
+  if (NULL == (frame = nwkFrameAlloc(route + size)))
+    return NULL;
+
+  frame->data.header.nwkFcf.sourceRoute = 0;
+#if NWK_SOURCE_ROUTE_TABLE_SIZE > 0
+  if (route)
+    nwkSourceRouteBuild(frame, req->dstAddr);
+#endif
+
+  return frame;
+}
+
+/*****************************************************************************
+*****************************************************************************/
+static void nwkDataReqQueueRequest(NWK_DataReq_t *req)
+{
+  req->state = NWK_DATA_REQ_STATE_INITIAL;
+  req->status = NWK_SUCCESS_STATUS;
+
+  nwkDataReqPush(&nwkDataReqSubmitHead, &nwkDataReqSubmitTail, req);
+}
+
+/*****************************************************************************
+*****************************************************************************/
+void NWK_DataReq(NWK_DataReq_t *req)
+{
+  req->frame = NULL;
+  nwkDataReqQueueRequest(req);
+}
+
+/*****************************************************************************
+*****************************************************************************/
+uint8_t *NWK_DataReqReserve(NWK_DataReq_t *req)
+{
+  NwkFrame_t *frame;
+
+  if (NULL == (frame = nwkDataReqFrameAlloc(req)))
+  {
+    req->frame = NULL;
+    return NULL;
+  }
+
+  req->frame = frame;
+  req->data = (uint8_t *)&frame->data + nwkFrameHeaderSize(frame);
+
+  return req->data;
+}
+
+/*****************************************************************************
+*****************************************************************************/
+static void nwkDataReqConfirm(NWK_DataReq_t *req, uint8_t status)
+{
+  req->state = NWK_DATA_REQ_STATE_CONFIRM;
+  req->status = status;
+  nwkDataReqPush(&nwkDataReqConfirmHead, &nwkDataReqConfirmTail, req);
+}
+
+/*****************************************************************************
+*****************************************************************************/
+void NWK_DataReqCommit(NWK_DataReq_t *req)
+{
+  NwkFrame_t *frame = req->frame;
+
+  // The size and options may have changed since the reservation, the
+  // payload must still fit the buffer that was picked for it
+  if (frame && nwkFrameHeaderSize(frame) - sizeof(NwkFrameHeader_t) +
+      nwkDataReqFrameSize(req) > nwkFrameCapacity(frame))
+  {
+    nwkFrameFree(frame);
+    req->frame = NULL;
+    nwkDataReqConfirm(req, NWK_OUT_OF_MEMORY_STATUS);
+    return;
+  }
+
+  nwkDataReqQueueRequest(req);
+}
+
+/*****************************************************************************
+*****************************************************************************/
+void NWK_DataReqRelease(NWK_DataReq_t *req)
+{
+  if (req->frame)
+    nwkFrameFree(req->frame);
+
+  req->frame = NULL;
+  req->data = NULL;
+}
+
+/*****************************************************************************
+*****************************************************************************/
+static void nwkDataReqSendFrame(NWK_DataReq_t *req)
+{
+  NwkFrame_t *frame = req->frame;
+  uint8_t size = nwkDataReqFrameSize(req);
+
+  if (frame)
+  {
+    frame->size = nwkFrameHeaderSize(frame) + size;
+  }
+  else if (NULL != (frame = nwkDataReqFrameAlloc(req)))
+  {
+    memcpy((uint8_t *)&frame->data + nwkFrameHeaderSize(frame), req->data, req->size);
+  }
+  else
   {
-    req->state = NWK_DATA_REQ_STATE_CONFIRM;
-    req->status = NWK_OUT_OF_MEMORY_STATUS;
+    nwkDataReqConfirm(req, NWK_OUT_OF_MEMORY_STATUS);
     return;
   }
 
@@ -114,6 +250,22 @@ static void nwkDataReqSendFrame(NWK_DataReq_t *req)
   req->state = NWK_DATA_REQ_STATE_WAIT_CONF;
 
   frame->tx.confirm = nwkDataReqTxConf;
+  frame->tx.req = req;
+
+  if (NWK_RETRIES_DEFAULT == req->retries)
+    frame->tx.retries = NWK_ACK_RETRIES;
+  else if (NWK_RETRIES_NONE == req->retries)
+    frame->tx.retries = 0;
+  else
+    frame->tx.retries = req->retries;
+  frame->tx.attempts = 0;
+
+  if (req->options & NWK_OPT_PRIORITY_HIGH)
+    frame->tx.trafficClass = NWK_TX_CLASS_FORWARDED;
+  else if (req->options & NWK_OPT_PRIORITY_LOW)
+    frame->tx.trafficClass = NWK_TX_CLASS_BROADCAST;
+  else
+    frame->tx.trafficClass = NWK_TX_CLASS_DATA;
   frame->tx.control = req->options & NWK_OPT_BROADCAST_PAN_ID ? NWK_TX_CONTROL_BROADCAST_PAN_ID : 0;
 
   frame->data.header.nwkFcf.ackRequest = req->options & NWK_OPT_ACK_REQUEST ? 1 : 0;
@@ -121,14 +273,27 @@ static void nwkDataReqSendFrame(NWK_DataReq_t *req)
   frame->data.header.nwkFcf.securityEnabled = req->options & NWK_OPT_ENABLE_SECURITY ? 1 : 0;
 #endif
   frame->data.header.nwkFcf.linkLocal = req->options & NWK_OPT_LINK_LOCAL ? 1 : 0;
-  frame->data.header.nwkFcf.reserved = 0;
+#ifdef NWK_ENABLE_MULTICAST
+  frame->data.header.nwkFcf.multicast = req->options & NWK_OPT_MULTICAST ? 1 : 0;
+#else
+  frame->data.header.nwkFcf.multicast = 0;
+#endif
+  frame->data.header.nwkFcf.retry = 0;
+#ifdef NWK_ENABLE_COLLECTION
+  frame->data.header.nwkFcf.collection = (NWK_COLLECTION_SINK_ADDR == req->dstAddr &&
+      0 == frame->data.header.nwkFcf.multicast) ? 1 : 0;
+#else
+  frame->data.header.nwkFcf.collection = 0;
+#endif
   frame->data.header.nwkSeq = ++nwkIb.nwkSeqNum;
   frame->data.header.nwkSrcAddr = nwkIb.addr;
   frame->data.header.nwkDstAddr = req->dstAddr;
   frame->data.header.nwkSrcEndpoint = req->srcEndpoint;
   frame->data.header.nwkDstEndpoint = req->dstEndpoint;
 
-  memcpy(frame->data.payload, req->data, req->size);
+#ifdef NWK_ENABLE_SOURCE_ROUTING
+  nwkSourceRouteRecordUpdate(req->dstAddr);
+#endif
 
   nwkTxFrame(frame);
 }
@@ -137,71 +302,43 @@ static void nwkDataReqSendFrame(NWK_DataReq_t *req)
 *****************************************************************************/
 static void nwkDataReqTxConf(NwkFrame_t *frame)
 {
-  for (NWK_DataReq_t *req = nwkDataReqQueue; req; req = req->next)
-  {
-    if (req->frame == frame)
-    {
-      req->status = frame->tx.status;
-      req->control = frame->tx.control;
-      req->state = NWK_DATA_REQ_STATE_CONFIRM;
-      break;
-    }
-  }
+  NWK_DataReq_t *req = frame->tx.req;
 
-  nwkFrameFree(frame);
-}
+  req->control = frame->tx.control;
+  nwkDataReqConfirm(req, frame->tx.status);
 
-/*****************************************************************************
-*****************************************************************************/
-static void nwkDataReqConfirm(NWK_DataReq_t *req)
-{
-  if (nwkDataReqQueue == req)
-  {
-    nwkDataReqQueue = nwkDataReqQueue->next;
-  }
-  else
-  {
-    NWK_DataReq_t *prev = nwkDataReqQueue;
-    while (prev->next != req)
-      prev = prev->next;
-    prev->next = ((NWK_DataReq_t *)prev->next)->next;
-  }
-
-  req->confirm(req);
+  nwkFrameFree(frame);
 }
 
 /*****************************************************************************
 *****************************************************************************/
 bool nwkDataReqBusy(void)
 {
-  return NULL != nwkDataReqQueue;
+  return NULL != nwkDataReqSubmitHead || NULL != nwkDataReqConfirmHead;
 }
 
 /*****************************************************************************
 *****************************************************************************/
 void nwkDataReqTaskHandler(void)
 {
-  for (NWK_DataReq_t *req = nwkDataReqQueue; req; req = req->next)
+  NWK_DataReq_t *last = nwkDataReqSubmitTail;
+  NWK_DataReq_t *req;
+
+  // Requests submitted from the confirmation callbacks below are left
+  // for the next pass
+  while (last && NULL != (req = nwkDataReqPop(&nwkDataReqSubmitHead, &nwkDataReqSubmitTail)))
   {
-    switch (req->state)
-    {
-      case NWK_DATA_REQ_STATE_INITIAL:
-      {
-        nwkDataReqSendFrame(req);
-        return;
-      } break;
-
-      case NWK_DATA_REQ_STATE_WAIT_CONF:
-        break;
-
-      case NWK_DATA_REQ_STATE_CONFIRM:
-      {
-        nwkDataReqConfirm(req);
-        return;
-      } break;
-
-      default:
-        break;
-    };
+    nwkDataReqSendFrame(req);
+    if (req == last)
+      break;
+  }
+
+  last = nwkDataReqConfirmTail;
+
+  while (last && NULL != (req = nwkDataReqPop(&nwkDataReqConfirmHead, &nwkDataReqConfirmTail)))
+  {
+    req->confirm(req);
+    if (req == last)
+      break;
   }
 }
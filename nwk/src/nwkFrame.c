@@ -47,6 +47,11 @@
 #include <string.h>
 #include "nwkPrivate.h"
 
+/*****************************************************************************
+*****************************************************************************/
+#define NWK_FRAME_SMALL_SIZE \
+            (sizeof(NwkFrame_t) - NWK_MAX_PAYLOAD_SIZE + NWK_SMALL_BUFFER_PAYLOAD_SIZE)
+
 /*****************************************************************************
 *****************************************************************************/
 enum
@@ -57,42 +62,146 @@ enum
 /*****************************************************************************
 *****************************************************************************/
 static NwkFrame_t nwkFrameFrames[NWK_BUFFERS_AMOUNT];
+static NwkFrame_t *nwkFrameFreeList;
+#if NWK_SMALL_BUFFERS_AMOUNT > 0
+static uint8_t nwkFrameSmallFrames[NWK_SMALL_BUFFERS_AMOUNT][NWK_FRAME_SMALL_SIZE];
+static NwkFrame_t *nwkFrameSmallFreeList;
+#endif
 
 /*****************************************************************************
 *****************************************************************************/
 void nwkFrameInit(void)
 {
+  nwkFrameFreeList = NULL;
+
   for (int i = 0; i < NWK_BUFFERS_AMOUNT; i++)
-    nwkFrameFrames[i].state = NWK_FRAME_STATE_FREE;
+    nwkFrameFree(&nwkFrameFrames[i]);
+
+#if NWK_SMALL_BUFFERS_AMOUNT > 0
+  nwkFrameSmallFreeList = NULL;
+
+  for (int i = 0; i < NWK_SMALL_BUFFERS_AMOUNT; i++)
+    nwkFrameFree((NwkFrame_t *)nwkFrameSmallFrames[i]);
+#endif
+}
+
+/*****************************************************************************
+*****************************************************************************/
+static NwkFrame_t *nwkFrameListPop(NwkFrame_t **list)
+{
+  NwkFrame_t *frame = *list;
+
+  if (frame)
+    *list = frame->next;
+
+  return frame;
 }
 
 /*****************************************************************************
 *****************************************************************************/
 NwkFrame_t *nwkFrameAlloc(uint8_t size)
 {
-  for (int i = 0; i < NWK_BUFFERS_AMOUNT; i++)
-  {
-    if (NWK_FRAME_STATE_FREE == nwkFrameFrames[i].state)
-    {
-      nwkFrameFrames[i].size = sizeof(NwkFrameHeader_t) + size;
-      return &nwkFrameFrames[i];
-    }
-  }
-  return NULL;
+  NwkFrame_t *frame = NULL;
+
+#if NWK_SMALL_BUFFERS_AMOUNT > 0
+  if (size <= NWK_SMALL_BUFFER_PAYLOAD_SIZE)
+    frame = nwkFrameListPop(&nwkFrameSmallFreeList);
+#endif
+
+  if (NULL == frame)
+    frame = nwkFrameListPop(&nwkFrameFreeList);
+
+  if (NULL == frame)
+    return NULL;
+
+  frame->next = NULL;
+  frame->size = sizeof(NwkFrameHeader_t) + size;
+  return frame;
+}
+
+/*****************************************************************************
+*****************************************************************************/
+#if NWK_SMALL_BUFFERS_AMOUNT > 0
+static inline bool nwkFrameIsSmall(NwkFrame_t *frame)
+{
+  return (uint8_t *)frame >= nwkFrameSmallFrames[0] &&
+      (uint8_t *)frame <= nwkFrameSmallFrames[NWK_SMALL_BUFFERS_AMOUNT - 1];
+}
+#endif
+
+/*****************************************************************************
+*****************************************************************************/
+uint8_t nwkFrameCapacity(NwkFrame_t *frame)
+{
+#if NWK_SMALL_BUFFERS_AMOUNT > 0
+  if (nwkFrameIsSmall(frame))
+    return NWK_SMALL_BUFFER_PAYLOAD_SIZE;
+#endif
+
+  (void)frame;
+  return NWK_MAX_PAYLOAD_SIZE;
 }
 
 /*****************************************************************************
 *****************************************************************************/
 void nwkFrameFree(NwkFrame_t *frame)
 {
+  NwkFrame_t **list = &nwkFrameFreeList;
+
+#if NWK_SMALL_BUFFERS_AMOUNT > 0
+  if (nwkFrameIsSmall(frame))
+    list = &nwkFrameSmallFreeList;
+#endif
+
   frame->state = NWK_FRAME_STATE_FREE;
+  frame->next = *list;
+  *list = frame;
+}
+
+/*****************************************************************************
+*****************************************************************************/
+bool nwkFramePoolExhausted(void)
+{
+  return NULL == nwkFrameFreeList;
 }
 
 /*****************************************************************************
 *****************************************************************************/
-NwkFrame_t *nwkFrameByIndex(uint8_t i)
+void nwkFrameQueueInit(NwkFrameQueue_t *queue)
 {
-  return &nwkFrameFrames[i];
+  queue->head = NULL;
+  queue->tail = NULL;
+}
+
+/*****************************************************************************
+*****************************************************************************/
+void nwkFrameQueuePush(NwkFrameQueue_t *queue, NwkFrame_t *frame)
+{
+  frame->next = NULL;
+
+  if (queue->tail)
+    queue->tail->next = frame;
+  else
+    queue->head = frame;
+
+  queue->tail = frame;
+}
+
+/*****************************************************************************
+*****************************************************************************/
+NwkFrame_t *nwkFrameQueuePop(NwkFrameQueue_t *queue)
+{
+  NwkFrame_t *frame = queue->head;
+
+  if (frame)
+  {
+    queue->head = frame->next;
+    if (NULL == queue->head)
+      queue->tail = NULL;
+    frame->next = NULL;
+  }
+
+  return frame;
 }
 
 /*****************************************************************************
@@ -100,17 +209,35 @@ NwkFrame_t *nwkFrameByIndex(uint8_t i)
 void nwkFrameCommandInit(NwkFrame_t *frame)
 {
   frame->tx.status = NWK_SUCCESS_STATUS;
-  frame->tx.timeout = 0;
+  frame->tx.deadline = 0;
   frame->tx.control = 0;
   frame->tx.confirm = NULL;
+  frame->tx.trafficClass = NWK_TX_CLASS_COMMAND;
+  frame->tx.retries = 0;
+  frame->tx.attempts = 0;
 
   frame->data.header.nwkFcf.ackRequest = 0;
   frame->data.header.nwkFcf.securityEnabled = 0;
   frame->data.header.nwkFcf.linkLocal = 0;
-  frame->data.header.nwkFcf.reserved = 0;
+  frame->data.header.nwkFcf.multicast = 0;
+  frame->data.header.nwkFcf.sourceRoute = 0;
+  frame->data.header.nwkFcf.retry = 0;
+  frame->data.header.nwkFcf.collection = 0;
   frame->data.header.nwkSeq = ++nwkIb.nwkSeqNum;
   frame->data.header.nwkSrcAddr = nwkIb.addr;
   frame->data.header.nwkDstAddr = 0;
   frame->data.header.nwkSrcEndpoint = 0;
   frame->data.header.nwkDstEndpoint = 0;
 }
+
+/*****************************************************************************
+*****************************************************************************/
+uint8_t nwkFrameHeaderSize(NwkFrame_t *frame)
+{
+#ifdef NWK_ENABLE_SOURCE_ROUTING
+  if (frame->data.header.nwkFcf.sourceRoute)
+    return sizeof(NwkFrameHeader_t) + sizeof(uint8_t) +
+        frame->data.payload[0] * sizeof(uint16_t);
+#endif
+  return sizeof(NwkFrameHeader_t);
+}
@@ -0,0 +1,178 @@
+/**
+ * \file nwkGroup.c
+ *
+ * \brief Multicast group management implementation
+ *
+ * Copyright (C) 2012 Atmel Corporation. All rights reserved.
+ *
+ * \asf_license_start
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. The name of Atmel may not be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * 4. This software may only be redistributed and used in connection with an
+ *    Atmel microcontroller product.
+ *
+ * THIS SOFTWARE IS PROVIDED BY ATMEL "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT ARE
+ * EXPRESSLY AND SPECIFICALLY DISCLAIMED. IN NO EVENT SHALL ATMEL BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * \asf_license_stop
+ *
+ * $Id$
+ *
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "nwk.h"
+#include "nwkPrivate.h"
+
+#ifdef NWK_ENABLE_MULTICAST
+
+/*****************************************************************************
+*****************************************************************************/
+#define NWK_GROUP_EMPTY      0xffff
+
+/*****************************************************************************
+*****************************************************************************/
+static uint16_t nwkGroupTable[NWK_GROUPS_AMOUNT];
+static uint8_t nwkGroupsAmount;
+
+/*****************************************************************************
+*****************************************************************************/
+void nwkGroupInit(void)
+{
+  for (uint8_t i = 0; i < NWK_GROUPS_AMOUNT; i++)
+    nwkGroupTable[i] = NWK_GROUP_EMPTY;
+
+  nwkGroupsAmount = 0;
+}
+
+/*****************************************************************************
+*****************************************************************************/
+static inline uint8_t nwkGroupHash(uint16_t group)
+{
+  return (uint8_t)(group ^ (group >> 8)) % NWK_GROUPS_AMOUNT;
+}
+
+/*****************************************************************************
+*****************************************************************************/
+static inline uint8_t nwkGroupNext(uint8_t index)
+{
+  return (++index == NWK_GROUPS_AMOUNT) ? 0 : index;
+}
+
+/*****************************************************************************
+*****************************************************************************/
+static uint8_t nwkGroupFind(uint16_t group)
+{
+  uint8_t index = nwkGroupHash(group);
+
+  // Linear probing, removal keeps the probe sequences free of holes, so
+  // the first empty slot ends the search
+  for (uint8_t i = 0; i < NWK_GROUPS_AMOUNT; i++)
+  {
+    if (group == nwkGroupTable[index])
+      return index;
+
+    if (NWK_GROUP_EMPTY == nwkGroupTable[index])
+      break;
+
+    index = nwkGroupNext(index);
+  }
+
+  return NWK_GROUPS_AMOUNT;
+}
+
+/*****************************************************************************
+*****************************************************************************/
+bool NWK_GroupIsMember(uint16_t group)
+{
+  return NWK_GROUP_EMPTY != group && nwkGroupFind(group) < NWK_GROUPS_AMOUNT;
+}
+
+/*****************************************************************************
+*****************************************************************************/
+bool NWK_GroupAdd(uint16_t group)
+{
+  uint8_t index;
+
+  if (NWK_GROUP_EMPTY == group)
+    return false;
+
+  if (nwkGroupFind(group) < NWK_GROUPS_AMOUNT)
+    return true;
+
+  if (NWK_GROUPS_AMOUNT == nwkGroupsAmount)
+    return false;
+
+  index = nwkGroupHash(group);
+  while (NWK_GROUP_EMPTY != nwkGroupTable[index])
+    index = nwkGroupNext(index);
+
+  nwkGroupTable[index] = group;
+  nwkGroupsAmount++;
+
+  return true;
+}
+
+/*****************************************************************************
+*****************************************************************************/
+bool NWK_GroupRemove(uint16_t group)
+{
+  uint8_t hole, index;
+
+  if (NWK_GROUP_EMPTY == group)
+    return false;
+
+  if (NWK_GROUPS_AMOUNT == (hole = nwkGroupFind(group)))
+    return false;
+
+  // Move back the entries that would become unreachable through the hole
+  nwkGroupTable[hole] = NWK_GROUP_EMPTY;
+  index = hole;
+
+  while (1)
+  {
+    uint8_t home;
+
+    index = nwkGroupNext(index);
+
+    if (NWK_GROUP_EMPTY == nwkGroupTable[index])
+      break;
+
+    home = nwkGroupHash(nwkGroupTable[index]);
+
+    if ((hole <= index) ? (home <= hole || home > index) : (home <= hole && home > index))
+    {
+      nwkGroupTable[hole] = nwkGroupTable[index];
+      nwkGroupTable[index] = NWK_GROUP_EMPTY;
+      hole = index;
+    }
+  }
+
+  nwkGroupsAmount--;
+
+  return true;
+}
+
+#endif // NWK_ENABLE_MULTICAST
@@ -0,0 +1,203 @@
+/**
+ * \file nwkLinkKey.c
+ *
+ * \brief Per-link security key table implementation
+ *
+ * Copyright (C) 2012 Atmel Corporation. All rights reserved.
+ *
+ * \asf_license_start
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. The name of Atmel may not be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * 4. This software may only be redistributed and used in connection with an
+ *    Atmel microcontroller product.
+ *
+ * THIS SOFTWARE IS PROVIDED BY ATMEL "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT ARE
+ * EXPRESSLY AND SPECIFICALLY DISCLAIMED. IN NO EVENT SHALL ATMEL BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * \asf_license_stop
+ *
+ * $Id$
+ *
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "nwk.h"
+#include "nwkPrivate.h"
+
+#if NWK_LINK_KEY_TABLE_SIZE > 0
+
+/*****************************************************************************
+*****************************************************************************/
+#define NWK_LINK_KEY_EMPTY      0xffff
+#define NWK_LINK_KEY_NONE       0xff
+#define NWK_LINK_KEY_CACHE_WAYS 2
+#define NWK_LINK_KEY_CACHE_SETS (NWK_LINK_KEY_CACHE_SIZE / NWK_LINK_KEY_CACHE_WAYS)
+
+/*****************************************************************************
+*****************************************************************************/
+typedef struct NwkLinkKey_t
+{
+  uint16_t   addr;
+  uint32_t   key[4];
+} NwkLinkKey_t;
+
+typedef struct NwkLinkKeyCache_t
+{
+  uint16_t   addr;
+  uint8_t    index; // NWK_LINK_KEY_NONE when the address has no link key
+} NwkLinkKeyCache_t;
+
+/*****************************************************************************
+*****************************************************************************/
+static NwkLinkKey_t nwkLinkKeyTable[NWK_LINK_KEY_TABLE_SIZE];
+static NwkLinkKeyCache_t nwkLinkKeyCache[NWK_LINK_KEY_CACHE_SETS][NWK_LINK_KEY_CACHE_WAYS];
+
+/*****************************************************************************
+*****************************************************************************/
+void nwkLinkKeyInit(void)
+{
+  for (uint8_t i = 0; i < NWK_LINK_KEY_TABLE_SIZE; i++)
+    nwkLinkKeyTable[i].addr = NWK_LINK_KEY_EMPTY;
+
+  for (uint8_t i = 0; i < NWK_LINK_KEY_CACHE_SETS; i++)
+  {
+    for (uint8_t j = 0; j < NWK_LINK_KEY_CACHE_WAYS; j++)
+    {
+      nwkLinkKeyCache[i][j].addr = NWK_LINK_KEY_EMPTY;
+      nwkLinkKeyCache[i][j].index = NWK_LINK_KEY_NONE;
+    }
+  }
+}
+
+/*****************************************************************************
+*****************************************************************************/
+static inline NwkLinkKeyCache_t *nwkLinkKeyCacheSet(uint16_t addr)
+{
+  return nwkLinkKeyCache[(uint8_t)(addr ^ (addr >> 8)) % NWK_LINK_KEY_CACHE_SETS];
+}
+
+/*****************************************************************************
+*****************************************************************************/
+static uint8_t nwkLinkKeyFind(uint16_t addr)
+{
+  for (uint8_t i = 0; i < NWK_LINK_KEY_TABLE_SIZE; i++)
+  {
+    if (addr == nwkLinkKeyTable[i].addr)
+      return i;
+  }
+
+  return NWK_LINK_KEY_NONE;
+}
+
+/*****************************************************************************
+*****************************************************************************/
+static NwkLinkKeyCache_t *nwkLinkKeyCacheLookup(uint16_t addr)
+{
+  NwkLinkKeyCache_t *set = nwkLinkKeyCacheSet(addr);
+  NwkLinkKeyCache_t entry;
+
+  // The first way holds the most recently used address of the set, the
+  // second one is replaced on a miss. Misses are cached as well, so peers
+  // using the network key do not cost a table search per frame either.
+  if (addr != set[0].addr)
+  {
+    entry = set[1];
+    set[1] = set[0];
+
+    if (addr != entry.addr)
+    {
+      entry.addr = addr;
+      entry.index = nwkLinkKeyFind(addr);
+    }
+
+    set[0] = entry;
+  }
+
+  return &set[0];
+}
+
+/*****************************************************************************
+*****************************************************************************/
+bool NWK_SetLinkKey(uint16_t addr, uint8_t *key)
+{
+  uint8_t index;
+
+  if (NWK_LINK_KEY_EMPTY == addr)
+    return false;
+
+  if (NWK_LINK_KEY_NONE == (index = nwkLinkKeyFind(addr)))
+    index = nwkLinkKeyFind(NWK_LINK_KEY_EMPTY);
+
+  if (NWK_LINK_KEY_NONE == index)
+    return false;
+
+  nwkLinkKeyTable[index].addr = addr;
+  memcpy((uint8_t *)nwkLinkKeyTable[index].key, key, NWK_SECURITY_KEY_SIZE);
+
+  // Table entries never move, an address can only be cached in one entry
+  nwkLinkKeyCacheLookup(addr)->index = index;
+
+  return true;
+}
+
+/*****************************************************************************
+*****************************************************************************/
+bool NWK_RemoveLinkKey(uint16_t addr)
+{
+  NwkLinkKeyCache_t *set;
+  uint8_t index;
+
+  if (NWK_LINK_KEY_EMPTY == addr)
+    return false;
+
+  if (NWK_LINK_KEY_NONE == (index = nwkLinkKeyFind(addr)))
+    return false;
+
+  nwkLinkKeyTable[index].addr = NWK_LINK_KEY_EMPTY;
+
+  set = nwkLinkKeyCacheSet(addr);
+  for (uint8_t i = 0; i < NWK_LINK_KEY_CACHE_WAYS; i++)
+  {
+    if (addr == set[i].addr)
+      set[i].index = NWK_LINK_KEY_NONE;
+  }
+
+  return true;
+}
+
+/*****************************************************************************
+*****************************************************************************/
+uint8_t *nwkLinkKeyGet(uint16_t addr)
+{
+  NwkLinkKeyCache_t *entry = nwkLinkKeyCacheLookup(addr);
+
+  if (NWK_LINK_KEY_NONE == entry->index)
+    return NULL;
+
+  return (uint8_t *)nwkLinkKeyTable[entry->index].key;
+}
+
+#endif // NWK_LINK_KEY_TABLE_SIZE > 0
@@ -47,24 +47,56 @@
 #include "nwk.h"
 #include "nwkPrivate.h"
 #include "sysTypes.h"
+#include "sysTimer.h"
 
 #ifdef NWK_ENABLE_ROUTING
 
 /*****************************************************************************
 *****************************************************************************/
-#define NWK_ROUTE_UNKNOWN           0xffff
 #define NWK_ROUTE_TRANSIT_MASK      0x8000
 
+#if NWK_ROUTE_TABLE_SIZE < 255
+  #define NWK_ROUTE_NONE            0xff
+  typedef uint8_t NwkRouteIndex_t;
+#else
+  #define NWK_ROUTE_NONE            0xffff
+  typedef uint16_t NwkRouteIndex_t;
+#endif
+
+// Power of 2, about two records per bucket
+#if NWK_ROUTE_TABLE_SIZE <= 16
+  #define NWK_ROUTE_HASH_SIZE       8
+#elif NWK_ROUTE_TABLE_SIZE <= 64
+  #define NWK_ROUTE_HASH_SIZE       32
+#elif NWK_ROUTE_TABLE_SIZE <= 256
+  #define NWK_ROUTE_HASH_SIZE       128
+#elif NWK_ROUTE_TABLE_SIZE <= 1024
+  #define NWK_ROUTE_HASH_SIZE       512
+#else
+  #define NWK_ROUTE_HASH_SIZE       2048
+#endif
+
 /*****************************************************************************
 *****************************************************************************/
 typedef struct NwkRouteTableRecord_t
 {
-  uint16_t   dst;
-  uint16_t   nextHop;
-  uint8_t    score;
-  uint8_t    lqi;
+  uint16_t          dst;
+  uint16_t          nextHop;
+  uint16_t          backupHop;
+  uint8_t           score;
+  NwkRouteIndex_t   hashNext;
+  NwkRouteIndex_t   lruPrev;
+  NwkRouteIndex_t   lruNext;
 } NwkRouteTableRecord_t;
 
+typedef struct NwkRouteNeighbourRecord_t
+{
+  uint16_t          addr;
+  uint16_t          etx;
+  bool              probed;
+  uint32_t          time;
+} NwkRouteNeighbourRecord_t;
+
 /*****************************************************************************
 *****************************************************************************/
 static void nwkRouteTxFrameConf(NwkFrame_t *frame);
@@ -74,29 +106,263 @@ static void nwkRouteErrorConf(NwkFrame_t *frame);
 /*****************************************************************************
 *****************************************************************************/
 static NwkRouteTableRecord_t nwkRouteTable[NWK_ROUTE_TABLE_SIZE];
+static NwkRouteIndex_t nwkRouteHash[NWK_ROUTE_HASH_SIZE];
+static NwkRouteIndex_t nwkRouteFree;
+static NwkRouteIndex_t nwkRouteLruHead; // most recently used
+static NwkRouteIndex_t nwkRouteLruTail;
+static NwkRouteNeighbourRecord_t nwkRouteNeighbourTable[NWK_ROUTE_NEIGHBOUR_TABLE_SIZE];
 
 /*****************************************************************************
 *****************************************************************************/
 void nwkRouteInit(void)
 {
-  for (uint8_t i = 0; i < NWK_ROUTE_TABLE_SIZE; i++)
+  for (NwkRouteIndex_t i = 0; i < NWK_ROUTE_TABLE_SIZE; i++)
+  {
     nwkRouteTable[i].dst = NWK_ROUTE_UNKNOWN;
+    nwkRouteTable[i].hashNext = i + 1;
+  }
+  nwkRouteTable[NWK_ROUTE_TABLE_SIZE - 1].hashNext = NWK_ROUTE_NONE;
+
+  for (uint16_t i = 0; i < NWK_ROUTE_HASH_SIZE; i++)
+    nwkRouteHash[i] = NWK_ROUTE_NONE;
+
+  nwkRouteFree = 0;
+  nwkRouteLruHead = NWK_ROUTE_NONE;
+  nwkRouteLruTail = NWK_ROUTE_NONE;
+
+  for (uint8_t i = 0; i < NWK_ROUTE_NEIGHBOUR_TABLE_SIZE; i++)
+    nwkRouteNeighbourTable[i].addr = NWK_ROUTE_UNKNOWN;
+
+#ifdef NWK_ENABLE_ROUTE_STORE
+  nwkRouteStoreInit();
+#endif
+}
+
+/*****************************************************************************
+*****************************************************************************/
+static NwkRouteNeighbourRecord_t *nwkRouteNeighbourFind(uint16_t addr)
+{
+  for (uint8_t i = 0; i < NWK_ROUTE_NEIGHBOUR_TABLE_SIZE; i++)
+    if (nwkRouteNeighbourTable[i].addr == addr)
+      return &nwkRouteNeighbourTable[i];
+  return NULL;
+}
+
+/*****************************************************************************
+*****************************************************************************/
+static NwkRouteNeighbourRecord_t *nwkRouteNeighbourNew(uint16_t addr, uint16_t etx)
+{
+  NwkRouteNeighbourRecord_t *rec = &nwkRouteNeighbourTable[0];
+  uint32_t time = SYS_TimerGetTime();
+
+  // Replace a free record or the least recently updated one
+  for (uint8_t i = 0; i < NWK_ROUTE_NEIGHBOUR_TABLE_SIZE; i++)
+  {
+    if (NWK_ROUTE_UNKNOWN == nwkRouteNeighbourTable[i].addr)
+    {
+      rec = &nwkRouteNeighbourTable[i];
+      break;
+    }
+
+    if (time - nwkRouteNeighbourTable[i].time > time - rec->time)
+      rec = &nwkRouteNeighbourTable[i];
+  }
+
+  rec->addr = addr;
+  rec->etx = etx;
+  rec->probed = false;
+  rec->time = time;
+
+  return rec;
+}
+
+/*****************************************************************************
+*****************************************************************************/
+static void nwkRouteNeighbourSample(NwkRouteNeighbourRecord_t *rec, uint16_t etx)
+{
+  // etx += (sample - etx) / 4
+  rec->etx += ((int16_t)etx - (int16_t)rec->etx) / 4;
+  rec->time = SYS_TimerGetTime();
+}
+
+/*****************************************************************************
+*****************************************************************************/
+static void nwkRouteNeighbourLqi(uint16_t addr, uint8_t lqi)
+{
+  NwkRouteNeighbourRecord_t *rec = nwkRouteNeighbourFind(addr);
+  uint16_t etx = NWK_ROUTE_ETX_ONE + ((255 - lqi) >> 1);
+
+  // LQI is only a guess until there is a delivery history for the link
+  if (NULL == rec)
+    nwkRouteNeighbourNew(addr, etx);
+  else if (!rec->probed)
+    nwkRouteNeighbourSample(rec, etx);
+  else
+    rec->time = SYS_TimerGetTime();
+}
+
+/*****************************************************************************
+*****************************************************************************/
+void nwkRouteLinkUpdate(uint16_t addr, bool success)
+{
+  NwkRouteNeighbourRecord_t *rec = nwkRouteNeighbourFind(addr);
+  uint16_t etx = success ? NWK_ROUTE_ETX_ONE : NWK_ROUTE_ETX_FAILURE;
+
+  if (NULL == rec)
+    rec = nwkRouteNeighbourNew(addr, etx);
+  else if (!rec->probed)
+    rec->etx = (rec->etx + etx) / 2;
+  else
+    nwkRouteNeighbourSample(rec, etx);
+
+  rec->time = SYS_TimerGetTime();
+  rec->probed = true;
+}
+
+/*****************************************************************************
+*****************************************************************************/
+uint16_t nwkRouteLinkEtx(uint16_t addr)
+{
+  NwkRouteNeighbourRecord_t *rec = nwkRouteNeighbourFind(addr);
+
+  return rec ? rec->etx : NWK_ROUTE_ETX_UNKNOWN;
+}
+
+/*****************************************************************************
+*****************************************************************************/
+static uint16_t nwkRouteCost(uint16_t dst, uint16_t nextHop)
+{
+  uint16_t cost = nwkRouteLinkEtx(nextHop);
+
+  // Links past the next hop are not known, but there is at least one
+  if (dst != nextHop)
+    cost += NWK_ROUTE_ETX_ONE;
+
+  return cost;
+}
+
+/*****************************************************************************
+*****************************************************************************/
+static NwkRouteIndex_t *nwkRouteBucket(uint16_t dst)
+{
+  return &nwkRouteHash[(dst ^ (dst >> 8)) & (NWK_ROUTE_HASH_SIZE - 1)];
+}
+
+/*****************************************************************************
+*****************************************************************************/
+static void nwkRouteLruUnlink(NwkRouteIndex_t index)
+{
+  NwkRouteTableRecord_t *rec = &nwkRouteTable[index];
+
+  if (NWK_ROUTE_NONE == rec->lruPrev)
+    nwkRouteLruHead = rec->lruNext;
+  else
+    nwkRouteTable[rec->lruPrev].lruNext = rec->lruNext;
+
+  if (NWK_ROUTE_NONE == rec->lruNext)
+    nwkRouteLruTail = rec->lruPrev;
+  else
+    nwkRouteTable[rec->lruNext].lruPrev = rec->lruPrev;
+}
+
+/*****************************************************************************
+*****************************************************************************/
+static void nwkRouteLruPushHead(NwkRouteIndex_t index)
+{
+  NwkRouteTableRecord_t *rec = &nwkRouteTable[index];
+
+  rec->lruPrev = NWK_ROUTE_NONE;
+  rec->lruNext = nwkRouteLruHead;
+
+  if (NWK_ROUTE_NONE == nwkRouteLruHead)
+    nwkRouteLruTail = index;
+  else
+    nwkRouteTable[nwkRouteLruHead].lruPrev = index;
+
+  nwkRouteLruHead = index;
+}
+
+/*****************************************************************************
+*****************************************************************************/
+static void nwkRouteTouch(NwkRouteTableRecord_t *rec)
+{
+  NwkRouteIndex_t index = rec - nwkRouteTable;
+
+  if (nwkRouteLruHead == index)
+    return;
+
+  nwkRouteLruUnlink(index);
+  nwkRouteLruPushHead(index);
 }
 
 /*****************************************************************************
 *****************************************************************************/
 static NwkRouteTableRecord_t *nwkRouteFindRecord(uint16_t dst)
 {
-  for (uint8_t i = 0; i < NWK_ROUTE_TABLE_SIZE; i++)
-    if (nwkRouteTable[i].dst == dst)
-      return &nwkRouteTable[i];
+  NwkRouteIndex_t index = *nwkRouteBucket(dst);
 
-  if (NWK_ROUTE_UNKNOWN == dst)
-    return &nwkRouteTable[NWK_ROUTE_TABLE_SIZE - 1];
+  while (NWK_ROUTE_NONE != index)
+  {
+    if (nwkRouteTable[index].dst == dst)
+      return &nwkRouteTable[index];
+    index = nwkRouteTable[index].hashNext;
+  }
 
   return NULL;
 }
 
+/*****************************************************************************
+*****************************************************************************/
+static void nwkRouteFreeRecord(NwkRouteTableRecord_t *rec)
+{
+  NwkRouteIndex_t *bucket = nwkRouteBucket(rec->dst);
+  NwkRouteIndex_t index = rec - nwkRouteTable;
+
+  if (*bucket == index)
+  {
+    *bucket = rec->hashNext;
+  }
+  else
+  {
+    NwkRouteIndex_t prev = *bucket;
+    while (nwkRouteTable[prev].hashNext != index)
+      prev = nwkRouteTable[prev].hashNext;
+    nwkRouteTable[prev].hashNext = rec->hashNext;
+  }
+
+  nwkRouteLruUnlink(index);
+
+  rec->dst = NWK_ROUTE_UNKNOWN;
+  rec->hashNext = nwkRouteFree;
+  nwkRouteFree = index;
+}
+
+/*****************************************************************************
+*****************************************************************************/
+static NwkRouteTableRecord_t *nwkRouteNewRecord(uint16_t dst)
+{
+  NwkRouteTableRecord_t *rec;
+  NwkRouteIndex_t *bucket;
+  NwkRouteIndex_t index;
+
+  // Evict the least recently used route when the table is full
+  if (NWK_ROUTE_NONE == nwkRouteFree)
+    nwkRouteFreeRecord(&nwkRouteTable[nwkRouteLruTail]);
+
+  index = nwkRouteFree;
+  rec = &nwkRouteTable[index];
+  nwkRouteFree = rec->hashNext;
+
+  bucket = nwkRouteBucket(dst);
+  rec->dst = dst;
+  rec->hashNext = *bucket;
+  *bucket = index;
+
+  nwkRouteLruPushHead(index);
+
+  return rec;
+}
+
 /*****************************************************************************
 *****************************************************************************/
 void nwkRouteRemove(uint16_t dst)
@@ -105,7 +371,12 @@ void nwkRouteRemove(uint16_t dst)
 
   rec = nwkRouteFindRecord(dst);
   if (rec)
-    rec->dst = NWK_ROUTE_UNKNOWN;
+    nwkRouteFreeRecord(rec);
+
+#ifdef NWK_ENABLE_COLLECTION
+  if (NWK_COLLECTION_SINK_ADDR == dst)
+    nwkCollectionParentLost();
+#endif
 }
 
 /*****************************************************************************
@@ -122,25 +393,47 @@ void nwkRouteFrameReceived(NwkFrame_t *frame)
   if (0xffff == header->macDstPanId)
     return;
 
+  nwkRouteNeighbourLqi(header->macSrcAddr, frame->rx.lqi);
+
+#ifdef NWK_ENABLE_COLLECTION
+  // Collection traffic from every node converges on the sink, a route per
+  // source would push the useful routes out of the table
+  if (header->nwkFcf.collection)
+    return;
+#endif
+
   rec = nwkRouteFindRecord(header->nwkSrcAddr);
   if (rec)
   {
-    if (rec->nextHop != header->macSrcAddr && frame->rx.lqi > rec->lqi)
+    if (rec->nextHop != header->macSrcAddr)
     {
-      rec->nextHop = header->macSrcAddr;
-      rec->score = NWK_ROUTE_DEFAULT_SCORE;
+      uint16_t cost = nwkRouteCost(rec->dst, header->macSrcAddr);
+
+      // Switch only to a clearly cheaper path, so noisy samples do not make
+      // the route flap between neighbours of similar quality. Otherwise
+      // keep the best other neighbour as a backup.
+      if (cost + NWK_ROUTE_ETX_HYSTERESIS < nwkRouteCost(rec->dst, rec->nextHop))
+      {
+        rec->backupHop = rec->nextHop;
+        rec->nextHop = header->macSrcAddr;
+        rec->score = NWK_ROUTE_DEFAULT_SCORE;
+      }
+      else if (NWK_ROUTE_UNKNOWN == rec->backupHop ||
+          cost < nwkRouteCost(rec->dst, rec->backupHop))
+      {
+        rec->backupHop = header->macSrcAddr;
+      }
     }
+    nwkRouteTouch(rec);
   }
   else
   {
-    rec = nwkRouteFindRecord(NWK_ROUTE_UNKNOWN);
+    rec = nwkRouteNewRecord(header->nwkSrcAddr);
 
-    rec->dst = header->nwkSrcAddr;
     rec->nextHop = header->macSrcAddr;
+    rec->backupHop = NWK_ROUTE_UNKNOWN;
     rec->score = NWK_ROUTE_DEFAULT_SCORE;
   }
-
-  rec->lqi = frame->rx.lqi;
 }
 
 /*****************************************************************************
@@ -149,6 +442,30 @@ void nwkRouteFrameSent(NwkFrame_t *frame)
 {
   NwkRouteTableRecord_t *rec;
 
+  // Group IDs share the address space, but group frames are never routed
+  if (frame->data.header.nwkFcf.multicast)
+    return;
+
+#ifdef NWK_ENABLE_SOURCE_ROUTING
+  // Source routed frames do not use the table. A failed path is forgotten,
+  // so the following frames are routed by the table until a new record.
+  if (frame->data.header.nwkFcf.sourceRoute)
+  {
+#if NWK_SOURCE_ROUTE_TABLE_SIZE > 0
+    if (nwkIb.addr == frame->data.header.nwkSrcAddr &&
+        (NWK_PHY_NO_ACK_STATUS == frame->tx.status || NWK_NO_ACK_STATUS == frame->tx.status))
+      nwkSourceRouteRemove(frame->data.header.nwkDstAddr);
+#endif
+    return;
+  }
+#endif
+
+#ifdef NWK_ENABLE_COLLECTION
+  if (NWK_COLLECTION_SINK_ADDR == frame->data.header.nwkDstAddr &&
+      nwkCollectionFrameSent(frame))
+    return;
+#endif
+
   rec = nwkRouteFindRecord(frame->data.header.nwkDstAddr);
   if (NULL == rec)
     return;
@@ -156,38 +473,54 @@ void nwkRouteFrameSent(NwkFrame_t *frame)
   if (NWK_SUCCESS_STATUS == frame->tx.status)
   {
     rec->score = NWK_ROUTE_DEFAULT_SCORE;
+    nwkRouteTouch(rec);
   }
   else
   {
     rec->score--;
     if (0 == rec->score)
     {
-      rec->dst = NWK_ROUTE_UNKNOWN;
-      return;
+      // After consecutive failures on the next hop the route fails over
+      // locally, it is removed only when there is no backup
+      if (NWK_ROUTE_UNKNOWN != rec->backupHop &&
+          frame->data.header.macDstAddr == rec->nextHop)
+      {
+        rec->nextHop = rec->backupHop;
+        rec->backupHop = NWK_ROUTE_UNKNOWN;
+        rec->score = NWK_ROUTE_DEFAULT_SCORE;
+      }
+      else
+      {
+        nwkRouteFreeRecord(rec);
+      }
     }
   }
-
-  if ((rec - &nwkRouteTable[0]) > 0)
-  {
-    NwkRouteTableRecord_t *prev = rec - 1;
-    NwkRouteTableRecord_t tmp;
-
-    tmp = *prev;
-    *prev = *rec;
-    *rec = tmp;
-  }
 }
 
 /*****************************************************************************
 *****************************************************************************/
 uint16_t nwkRouteNextHop(uint16_t dst)
 {
+  NwkRouteTableRecord_t *rec;
+
   if (0xffff == dst)
     return NWK_ROUTE_UNKNOWN;
 
-  for (uint8_t i = 0; i < NWK_ROUTE_TABLE_SIZE; i++)
-    if (nwkRouteTable[i].dst == dst)
-      return nwkRouteTable[i].nextHop;
+#ifdef NWK_ENABLE_COLLECTION
+  // Sink bound frames follow the parent pointer, the table is only
+  // a fallback while the node has no parent
+  if (NWK_COLLECTION_SINK_ADDR == dst)
+  {
+    uint16_t parent = nwkCollectionNextHop();
+
+    if (NWK_ROUTE_UNKNOWN != parent)
+      return parent;
+  }
+#endif
+
+  rec = nwkRouteFindRecord(dst);
+  if (rec)
+    return rec->nextHop;
 
   return NWK_ROUTE_UNKNOWN;
 }
@@ -196,10 +529,23 @@ uint16_t nwkRouteNextHop(uint16_t dst)
 *****************************************************************************/
 void nwkRouteFrame(NwkFrame_t *frame)
 {
-  if (NWK_ROUTE_UNKNOWN != nwkRouteNextHop(frame->data.header.nwkDstAddr))
+  uint16_t nextHop;
+
+#ifdef NWK_ENABLE_SOURCE_ROUTING
+  if (frame->data.header.nwkFcf.sourceRoute)
+    nextHop = nwkSourceRouteNextHop(frame);
+  else
+#endif
+    nextHop = nwkRouteNextHop(frame->data.header.nwkDstAddr);
+
+  if (NWK_ROUTE_UNKNOWN != nextHop)
   {
+#ifdef NWK_ENABLE_SOURCE_ROUTING
+    nwkSourceRouteRecordForward(frame);
+#endif
     frame->tx.confirm = nwkRouteTxFrameConf;
     frame->tx.control = NWK_TX_CONTROL_ROUTING;
+    frame->tx.trafficClass = NWK_TX_CLASS_FORWARDED;
     nwkTxFrame(frame);
   }
   else
@@ -255,7 +601,65 @@ void nwkRouteErrorReceived(NWK_DataInd_t *ind)
   NwkRouteErrorCommand_t *command = (NwkRouteErrorCommand_t *)ind->data;
 
   nwkRouteRemove(command->dstAddr);
+#if NWK_SOURCE_ROUTE_TABLE_SIZE > 0
+  nwkSourceRouteRemove(command->dstAddr);
+#endif
+}
+
+#ifdef NWK_ENABLE_ROUTE_STORE
+/*****************************************************************************
+*****************************************************************************/
+void nwkRouteExport(uint16_t index, NwkRouteStoreRoute_t *route)
+{
+  NwkRouteTableRecord_t *rec = &nwkRouteTable[index];
+
+  route->dst = rec->dst;
+  route->nextHop = (NWK_ROUTE_UNKNOWN == rec->dst) ? NWK_ROUTE_UNKNOWN : rec->nextHop;
+}
+
+/*****************************************************************************
+*****************************************************************************/
+void nwkRouteImport(NwkRouteStoreRoute_t *route)
+{
+  NwkRouteTableRecord_t *rec;
+
+  if (NWK_ROUTE_UNKNOWN == route->dst || NWK_ROUTE_UNKNOWN == route->nextHop ||
+      nwkRouteFindRecord(route->dst))
+    return;
+
+  rec = nwkRouteNewRecord(route->dst);
+
+  // The route may be stale, the first failure removes it
+  rec->nextHop = route->nextHop;
+  rec->backupHop = NWK_ROUTE_UNKNOWN;
+  rec->score = 1;
+}
+
+/*****************************************************************************
+*****************************************************************************/
+void nwkRouteNeighbourExport(uint8_t index, NwkRouteStoreNeighbour_t *neighbour)
+{
+  NwkRouteNeighbourRecord_t *rec = &nwkRouteNeighbourTable[index];
+  uint16_t etx = rec->etx >> 3;
+
+  // Half transmission steps, so the estimate does not rewrite EEPROM on
+  // every sample
+  neighbour->addr = rec->addr;
+  neighbour->etx = (NWK_ROUTE_UNKNOWN == rec->addr) ? 0xff : (etx > 0xfe ? 0xfe : etx);
+}
+
+/*****************************************************************************
+*****************************************************************************/
+void nwkRouteNeighbourImport(NwkRouteStoreNeighbour_t *neighbour)
+{
+  if (NWK_ROUTE_UNKNOWN == neighbour->addr || 0xff == neighbour->etx ||
+      nwkRouteNeighbourFind(neighbour->addr))
+    return;
+
+  // Not probed, so the first delivery results replace the old estimate
+  nwkRouteNeighbourNew(neighbour->addr, (uint16_t)neighbour->etx << 3);
 }
+#endif
 
 /*****************************************************************************
 *****************************************************************************/
@@ -0,0 +1,262 @@
+/**
+ * \file nwkRouteDiscovery.c
+ *
+ * \brief Route discovery implementation
+ *
+ * Copyright (C) 2012 Atmel Corporation. All rights reserved.
+ *
+ * \asf_license_start
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. The name of Atmel may not be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * 4. This software may only be redistributed and used in connection with an
+ *    Atmel microcontroller product.
+ *
+ * THIS SOFTWARE IS PROVIDED BY ATMEL "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT ARE
+ * EXPRESSLY AND SPECIFICALLY DISCLAIMED. IN NO EVENT SHALL ATMEL BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * \asf_license_stop
+ *
+ * $Id$
+ *
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "nwk.h"
+#include "nwkPrivate.h"
+#include "sysTimer.h"
+
+#ifdef NWK_ENABLE_ROUTE_DISCOVERY
+
+/*****************************************************************************
+*****************************************************************************/
+#define NWK_ROUTE_DISCOVERY_RETRY_INTERVAL    50 // ms
+
+/*****************************************************************************
+*****************************************************************************/
+typedef struct NwkRouteDiscoveryRecord_t
+{
+  uint16_t          dst;
+  uint16_t          time;
+  bool              requestSent;
+  NwkFrameQueue_t   frames;
+} NwkRouteDiscoveryRecord_t;
+
+/*****************************************************************************
+*****************************************************************************/
+static void nwkRouteDiscoveryTimerHandler(SYS_Timer_t *timer);
+static void nwkRouteDiscoveryCommandConf(NwkFrame_t *frame);
+
+/*****************************************************************************
+*****************************************************************************/
+static NwkRouteDiscoveryRecord_t nwkRouteDiscoveryTable[NWK_ROUTE_DISCOVERY_TABLE_SIZE];
+static SYS_Timer_t nwkRouteDiscoveryTimer;
+
+/*****************************************************************************
+*****************************************************************************/
+void nwkRouteDiscoveryInit(void)
+{
+  for (uint8_t i = 0; i < NWK_ROUTE_DISCOVERY_TABLE_SIZE; i++)
+    nwkRouteDiscoveryTable[i].dst = 0xffff;
+
+  nwkRouteDiscoveryTimer.mode = SYS_TIMER_INTERVAL_MODE;
+  nwkRouteDiscoveryTimer.handler = nwkRouteDiscoveryTimerHandler;
+}
+
+/*****************************************************************************
+*****************************************************************************/
+static NwkRouteDiscoveryRecord_t *nwkRouteDiscoveryFindRecord(uint16_t dst)
+{
+  for (uint8_t i = 0; i < NWK_ROUTE_DISCOVERY_TABLE_SIZE; i++)
+    if (nwkRouteDiscoveryTable[i].dst == dst)
+      return &nwkRouteDiscoveryTable[i];
+  return NULL;
+}
+
+/*****************************************************************************
+*****************************************************************************/
+static bool nwkRouteDiscoverySendCommand(uint8_t id, uint16_t dstAddr, uint16_t src, uint16_t dst)
+{
+  NwkRouteDiscoveryCommand_t *command;
+  NwkFrame_t *frame;
+
+  if (NULL == (frame = nwkFrameAlloc(sizeof(NwkRouteDiscoveryCommand_t))))
+    return false;
+
+  nwkFrameCommandInit(frame);
+
+  frame->tx.confirm = nwkRouteDiscoveryCommandConf;
+
+  frame->data.header.nwkDstAddr = dstAddr;
+
+  command = (NwkRouteDiscoveryCommand_t *)frame->data.payload;
+
+  command->id = id;
+  command->srcAddr = src;
+  command->dstAddr = dst;
+
+  nwkTxFrame(frame);
+
+  return true;
+}
+
+/*****************************************************************************
+*****************************************************************************/
+static void nwkRouteDiscoveryCommandConf(NwkFrame_t *frame)
+{
+  nwkFrameFree(frame);
+}
+
+/*****************************************************************************
+*****************************************************************************/
+static void nwkRouteDiscoveryStartTimer(void)
+{
+  uint16_t time = SYS_TimerGetTime();
+  uint16_t interval = 0xffff;
+
+  // The timer is armed for the earliest deadline only. A request that could
+  // not be sent is retried after NWK_ROUTE_DISCOVERY_RETRY_INTERVAL.
+  for (uint8_t i = 0; i < NWK_ROUTE_DISCOVERY_TABLE_SIZE; i++)
+  {
+    NwkRouteDiscoveryRecord_t *rec = &nwkRouteDiscoveryTable[i];
+    uint16_t age, left;
+
+    if (0xffff == rec->dst)
+      continue;
+
+    age = time - rec->time;
+    left = (age < NWK_ROUTE_DISCOVERY_TIMEOUT) ? NWK_ROUTE_DISCOVERY_TIMEOUT - age : 0;
+
+    if (!rec->requestSent && left > NWK_ROUTE_DISCOVERY_RETRY_INTERVAL)
+      left = NWK_ROUTE_DISCOVERY_RETRY_INTERVAL;
+
+    if (left < interval)
+      interval = left;
+  }
+
+  SYS_TimerStop(&nwkRouteDiscoveryTimer);
+
+  if (0xffff != interval)
+  {
+    nwkRouteDiscoveryTimer.interval = interval;
+    SYS_TimerStart(&nwkRouteDiscoveryTimer);
+  }
+}
+
+/*****************************************************************************
+*****************************************************************************/
+static void nwkRouteDiscoveryComplete(NwkRouteDiscoveryRecord_t *rec, bool found)
+{
+  NwkFrame_t *frame;
+
+  rec->dst = 0xffff;
+
+  while (NULL != (frame = nwkFrameQueuePop(&rec->frames)))
+    nwkTxRouteDiscoveryConf(frame, found);
+}
+
+/*****************************************************************************
+*****************************************************************************/
+bool nwkRouteDiscoveryRequest(NwkFrame_t *frame)
+{
+  uint16_t dst = frame->data.header.nwkDstAddr;
+  NwkRouteDiscoveryRecord_t *rec;
+
+  // Frames for a destination that is already being discovered only wait,
+  // a new request is not sent
+  if (NULL == (rec = nwkRouteDiscoveryFindRecord(dst)))
+  {
+    if (NULL == (rec = nwkRouteDiscoveryFindRecord(0xffff)))
+      return false;
+
+    rec->dst = dst;
+    rec->time = SYS_TimerGetTime();
+    rec->requestSent = nwkRouteDiscoverySendCommand(NWK_COMMAND_ROUTE_REQUEST,
+        0xffff, nwkIb.addr, dst);
+    nwkFrameQueueInit(&rec->frames);
+
+    nwkRouteDiscoveryStartTimer();
+  }
+
+  nwkFrameQueuePush(&rec->frames, frame);
+
+  return true;
+}
+
+/*****************************************************************************
+*****************************************************************************/
+void nwkRouteDiscoveryRequestReceived(NWK_DataInd_t *ind)
+{
+  NwkRouteDiscoveryCommand_t *command = (NwkRouteDiscoveryCommand_t *)ind->data;
+
+  // The request flood has already set up the reverse path to the originator
+  if (command->dstAddr == nwkIb.addr)
+    nwkRouteDiscoverySendCommand(NWK_COMMAND_ROUTE_REPLY, command->srcAddr,
+        command->srcAddr, nwkIb.addr);
+}
+
+/*****************************************************************************
+*****************************************************************************/
+void nwkRouteDiscoveryReplyReceived(NWK_DataInd_t *ind)
+{
+  NwkRouteDiscoveryCommand_t *command = (NwkRouteDiscoveryCommand_t *)ind->data;
+  NwkRouteDiscoveryRecord_t *rec;
+
+  // The reply itself has set up the forward path to the destination
+  rec = nwkRouteDiscoveryFindRecord(command->dstAddr);
+  if (rec && 0xffff != nwkRouteNextHop(command->dstAddr))
+  {
+    nwkRouteDiscoveryComplete(rec, true);
+    nwkRouteDiscoveryStartTimer();
+  }
+}
+
+/*****************************************************************************
+*****************************************************************************/
+static void nwkRouteDiscoveryTimerHandler(SYS_Timer_t *timer)
+{
+  uint16_t time = SYS_TimerGetTime();
+
+  for (uint8_t i = 0; i < NWK_ROUTE_DISCOVERY_TABLE_SIZE; i++)
+  {
+    NwkRouteDiscoveryRecord_t *rec = &nwkRouteDiscoveryTable[i];
+
+    if (0xffff == rec->dst)
+      continue;
+
+    if (0xffff != nwkRouteNextHop(rec->dst))
+      nwkRouteDiscoveryComplete(rec, true);
+    else if ((uint16_t)(time - rec->time) >= NWK_ROUTE_DISCOVERY_TIMEOUT)
+      nwkRouteDiscoveryComplete(rec, false);
+    else if (!rec->requestSent)
+      rec->requestSent = nwkRouteDiscoverySendCommand(NWK_COMMAND_ROUTE_REQUEST,
+          0xffff, nwkIb.addr, rec->dst);
+  }
+
+  nwkRouteDiscoveryStartTimer();
+  (void)timer;
+}
+
+#endif // NWK_ENABLE_ROUTE_DISCOVERY
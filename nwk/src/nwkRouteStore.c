@@ -0,0 +1,226 @@
+/**
+ * \file nwkRouteStore.c
+ *
+ * \brief Route table persistence implementation
+ *
+ * Copyright (C) 2012 Atmel Corporation. All rights reserved.
+ *
+ * \asf_license_start
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. The name of Atmel may not be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * 4. This software may only be redistributed and used in connection with an
+ *    Atmel microcontroller product.
+ *
+ * THIS SOFTWARE IS PROVIDED BY ATMEL "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT ARE
+ * EXPRESSLY AND SPECIFICALLY DISCLAIMED. IN NO EVENT SHALL ATMEL BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * \asf_license_stop
+ *
+ * $Id$
+ *
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "nwk.h"
+#include "nwkPrivate.h"
+#include "sysTimer.h"
+#include "halEeprom.h"
+
+#ifdef NWK_ENABLE_ROUTE_STORE
+
+/*****************************************************************************
+*****************************************************************************/
+#define NWK_ROUTE_STORE_MAGIC            0x5352
+#define NWK_ROUTE_STORE_VERSION          1
+#define NWK_ROUTE_STORE_BYTES_PER_CALL   16
+#define NWK_ROUTE_STORE_ITEMS            (1 + NWK_ROUTE_TABLE_SIZE + NWK_ROUTE_NEIGHBOUR_TABLE_SIZE)
+
+/*****************************************************************************
+*****************************************************************************/
+typedef struct PACK NwkRouteStoreHeader_t
+{
+  uint16_t   magic;
+  uint8_t    version;
+  uint16_t   routes;
+  uint8_t    neighbours;
+} NwkRouteStoreHeader_t;
+
+typedef union NwkRouteStoreItem_t
+{
+  NwkRouteStoreHeader_t      header;
+  NwkRouteStoreRoute_t       route;
+  NwkRouteStoreNeighbour_t   neighbour;
+} NwkRouteStoreItem_t;
+
+/*****************************************************************************
+*****************************************************************************/
+static void nwkRouteStoreTimerHandler(SYS_Timer_t *timer);
+
+/*****************************************************************************
+*****************************************************************************/
+static SYS_Timer_t nwkRouteStoreTimer;
+static bool nwkRouteStoreActive;
+static uint16_t nwkRouteStoreIndex;
+static uint16_t nwkRouteStoreAddr;
+static NwkRouteStoreItem_t nwkRouteStoreItem;
+static uint8_t nwkRouteStoreItemSize;
+static uint8_t nwkRouteStoreItemOffset;
+
+/*****************************************************************************
+*****************************************************************************/
+static void nwkRouteStoreRead(uint16_t addr, uint8_t *data, uint8_t size)
+{
+  for (uint8_t i = 0; i < size; i++)
+    data[i] = HAL_EepromReadByte(addr + i);
+}
+
+/*****************************************************************************
+*****************************************************************************/
+static void nwkRouteStoreHeader(NwkRouteStoreHeader_t *header)
+{
+  header->magic = NWK_ROUTE_STORE_MAGIC;
+  header->version = NWK_ROUTE_STORE_VERSION;
+  header->routes = NWK_ROUTE_TABLE_SIZE;
+  header->neighbours = NWK_ROUTE_NEIGHBOUR_TABLE_SIZE;
+}
+
+/*****************************************************************************
+*****************************************************************************/
+void nwkRouteStoreInit(void)
+{
+  NwkRouteStoreHeader_t header, stored;
+  uint16_t addr = NWK_ROUTE_STORE_ADDR;
+
+  nwkRouteStoreHeader(&header);
+  nwkRouteStoreRead(addr, (uint8_t *)&stored, sizeof(stored));
+  addr += sizeof(stored);
+
+  // A snapshot made with a different layout is ignored and overwritten
+  if (0 == memcmp(&header, &stored, sizeof(header)))
+  {
+    for (uint16_t i = 0; i < NWK_ROUTE_TABLE_SIZE; i++)
+    {
+      NwkRouteStoreRoute_t route;
+
+      nwkRouteStoreRead(addr, (uint8_t *)&route, sizeof(route));
+      addr += sizeof(route);
+      nwkRouteImport(&route);
+    }
+
+    for (uint8_t i = 0; i < NWK_ROUTE_NEIGHBOUR_TABLE_SIZE; i++)
+    {
+      NwkRouteStoreNeighbour_t neighbour;
+
+      nwkRouteStoreRead(addr, (uint8_t *)&neighbour, sizeof(neighbour));
+      addr += sizeof(neighbour);
+      nwkRouteNeighbourImport(&neighbour);
+    }
+  }
+
+  nwkRouteStoreActive = false;
+
+  nwkRouteStoreTimer.interval = NWK_ROUTE_STORE_INTERVAL;
+  nwkRouteStoreTimer.mode = SYS_TIMER_PERIODIC_MODE;
+  nwkRouteStoreTimer.handler = nwkRouteStoreTimerHandler;
+  SYS_TimerStart(&nwkRouteStoreTimer);
+}
+
+/*****************************************************************************
+*****************************************************************************/
+static void nwkRouteStoreFetch(void)
+{
+  uint16_t index = nwkRouteStoreIndex;
+
+  if (0 == index)
+  {
+    nwkRouteStoreHeader(&nwkRouteStoreItem.header);
+    nwkRouteStoreItemSize = sizeof(NwkRouteStoreHeader_t);
+  }
+  else if (index <= NWK_ROUTE_TABLE_SIZE)
+  {
+    nwkRouteExport(index - 1, &nwkRouteStoreItem.route);
+    nwkRouteStoreItemSize = sizeof(NwkRouteStoreRoute_t);
+  }
+  else
+  {
+    nwkRouteNeighbourExport(index - 1 - NWK_ROUTE_TABLE_SIZE, &nwkRouteStoreItem.neighbour);
+    nwkRouteStoreItemSize = sizeof(NwkRouteStoreNeighbour_t);
+  }
+
+  nwkRouteStoreItemOffset = 0;
+}
+
+/*****************************************************************************
+*****************************************************************************/
+static void nwkRouteStoreTimerHandler(SYS_Timer_t *timer)
+{
+  if (nwkRouteStoreActive)
+    return;
+
+  nwkRouteStoreActive = true;
+  nwkRouteStoreIndex = 0;
+  nwkRouteStoreAddr = NWK_ROUTE_STORE_ADDR;
+  nwkRouteStoreFetch();
+
+  (void)timer;
+}
+
+/*****************************************************************************
+*****************************************************************************/
+void nwkRouteStoreTaskHandler(void)
+{
+  if (!nwkRouteStoreActive)
+    return;
+
+  // Each item is copied when the pass reaches it and compared with the
+  // snapshot byte by byte. Only changed bytes are written, one at a time,
+  // and the task never waits for the EEPROM.
+  for (uint8_t i = 0; i < NWK_ROUTE_STORE_BYTES_PER_CALL; i++)
+  {
+    uint8_t byte = ((uint8_t *)&nwkRouteStoreItem)[nwkRouteStoreItemOffset];
+
+    if (!HAL_EepromReady())
+      return;
+
+    if (HAL_EepromReadByte(nwkRouteStoreAddr) != byte)
+      HAL_EepromWriteByte(nwkRouteStoreAddr, byte);
+
+    nwkRouteStoreAddr++;
+
+    if (++nwkRouteStoreItemOffset == nwkRouteStoreItemSize)
+    {
+      if (++nwkRouteStoreIndex == NWK_ROUTE_STORE_ITEMS)
+      {
+        nwkRouteStoreActive = false;
+        return;
+      }
+
+      nwkRouteStoreFetch();
+    }
+  }
+}
+
+#endif // NWK_ENABLE_ROUTE_STORE
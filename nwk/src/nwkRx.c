@@ -52,9 +52,23 @@
 
 /*****************************************************************************
 *****************************************************************************/
-#define NWK_RX_DUPLICATE_REJECTION_TIMER_INTERVAL   20 // ms
-#define DUPLICATE_REJECTION_TTL \
-            ((NWK_DUPLICATE_REJECTION_TTL / NWK_RX_DUPLICATE_REJECTION_TIMER_INTERVAL) + 1)
+#define NWK_RX_DUPLICATE_REJECTION_WINDOW   32
+#define NWK_RX_DUPLICATE_REJECTION_PROBES \
+            ((NWK_DUPLICATE_REJECTION_TABLE_SIZE < 8) ? NWK_DUPLICATE_REJECTION_TABLE_SIZE : 8)
+#define NWK_RX_DUPLICATE_REJECTION_TICK     4 // log2(ms)
+#define NWK_RX_DUPLICATE_REJECTION_TTL \
+            ((NWK_DUPLICATE_REJECTION_TTL + (1ul << NWK_RX_DUPLICATE_REJECTION_TICK) - 1) >> \
+            NWK_RX_DUPLICATE_REJECTION_TICK)
+
+// Record ages are 16-bit tick differences. While the table holds records,
+// expired ones are cleared every quarter of the tick range, so an age never
+// wraps around while the record is still in the table.
+#define NWK_RX_DUPLICATE_REJECTION_SWEEP_INTERVAL \
+            (0x4000ul << NWK_RX_DUPLICATE_REJECTION_TICK) // ms
+
+#if NWK_RX_DUPLICATE_REJECTION_TTL > 0x7fff
+  #error NWK_DUPLICATE_REJECTION_TTL is too large
+#endif
 #define NWK_SERVICE_ENDPOINT_ID    0
 
 /*****************************************************************************
@@ -72,7 +86,12 @@ typedef struct NwkDuplicateRejectionRecord_t
 {
   uint16_t   src;
   uint8_t    seq;
-  uint16_t   ttl;
+  uint8_t    macSeq;
+  uint8_t    retry;
+  bool       acked;  // seq was indicated and acknowledged
+  uint8_t    ackControl;
+  uint32_t   window; // bit N is set when (seq - N) was received
+  uint16_t   time;   // ticks
 } NwkDuplicateRejectionRecord_t;
 
 /*****************************************************************************
@@ -84,9 +103,17 @@ static bool nwkRxSeriveDataInd(NWK_DataInd_t *ind);
 /*****************************************************************************
 *****************************************************************************/
 static NwkDuplicateRejectionRecord_t nwkRxDuplicateRejectionTable[NWK_DUPLICATE_REJECTION_TABLE_SIZE];
+static SYS_Timer_t nwkRxDuplicateRejectionTimer;
 static uint8_t nwkRxActiveFrames;
+static NwkFrameQueue_t nwkRxQueue;
+static NwkFrame_t *nwkRxPhyFrame;
 static uint8_t nwkRxAckControl;
-static SYS_Timer_t nwkRxDuplicateRejectionTimer;
+#ifdef NWK_ENABLE_STATISTICS
+static NWK_DuplicateStats_t nwkRxDuplicateStats;
+#ifdef NWK_ENABLE_SECURITY
+static NWK_SecurityStats_t nwkRxSecurityStats;
+#endif
+#endif
 
 /*****************************************************************************
 *****************************************************************************/
@@ -100,36 +127,58 @@ void NWK_SetAckControl(uint8_t control)
 void nwkRxInit(void)
 {
   for (uint8_t i = 0; i < NWK_DUPLICATE_REJECTION_TABLE_SIZE; i++)
-    nwkRxDuplicateRejectionTable[i].ttl = 0;
+    nwkRxDuplicateRejectionTable[i].src = 0xffff;
 
-  nwkRxActiveFrames = 0;
-
-  nwkRxDuplicateRejectionTimer.interval = NWK_RX_DUPLICATE_REJECTION_TIMER_INTERVAL;
+  nwkRxDuplicateRejectionTimer.interval = NWK_RX_DUPLICATE_REJECTION_SWEEP_INTERVAL;
   nwkRxDuplicateRejectionTimer.mode = SYS_TIMER_INTERVAL_MODE;
   nwkRxDuplicateRejectionTimer.handler = nwkRxDuplicateRejectionTimerHandler;
 
+#ifdef NWK_ENABLE_STATISTICS
+  memset(&nwkRxDuplicateStats, 0, sizeof(nwkRxDuplicateStats));
+#ifdef NWK_ENABLE_SECURITY
+  memset(&nwkRxSecurityStats, 0, sizeof(nwkRxSecurityStats));
+#endif
+#endif
+
+  nwkRxActiveFrames = 0;
+  nwkFrameQueueInit(&nwkRxQueue);
+  nwkRxPhyFrame = NULL;
+
   NWK_OpenEndpoint(NWK_SERVICE_ENDPOINT_ID, nwkRxSeriveDataInd);
 }
 
+/*****************************************************************************
+*****************************************************************************/
+uint8_t *PHY_DataIndBuffer(uint8_t size)
+{
+  if (size < sizeof(NwkFrameHeader_t) || size > sizeof(NwkFrameHeader_t) + NWK_MAX_PAYLOAD_SIZE)
+    return NULL;
+
+  if (NULL == (nwkRxPhyFrame = nwkFrameAlloc(size - sizeof(NwkFrameHeader_t))))
+    return NULL;
+
+  return (uint8_t *)&nwkRxPhyFrame->data;
+}
+
 /*****************************************************************************
 *****************************************************************************/
 void PHY_DataInd(PHY_DataInd_t *ind)
 {
-  NwkFrame_t *frame;
+  NwkFrame_t *frame = nwkRxPhyFrame;
 
-  if (0x88 != ind->data[1] || (0x61 != ind->data[0] && 0x41 != ind->data[0]) ||
-      ind->size < sizeof(NwkFrameHeader_t))
-    return;
+  nwkRxPhyFrame = NULL;
 
-  if (NULL == (frame = nwkFrameAlloc(ind->size - sizeof(NwkFrameHeader_t))))
+  if (0x88 != ind->data[1] || (0x61 != ind->data[0] && 0x41 != ind->data[0]))
+  {
+    nwkFrameFree(frame);
     return;
+  }
 
   frame->state = NWK_RX_STATE_RECEIVED;
   frame->rx.lqi = ind->lqi;
   frame->rx.rssi = ind->rssi;
 
-  memcpy((uint8_t *)&frame->data, ind->data, ind->size);
-
+  nwkFrameQueuePush(&nwkRxQueue, frame);
   ++nwkRxActiveFrames;
 }
 
@@ -181,70 +230,188 @@ void nwkRxDecryptConf(NwkFrame_t *frame, bool status)
     frame->state = NWK_RX_STATE_INDICATE;
   else
     frame->state = NWK_RX_STATE_FINISH;
+
+  nwkFrameQueuePush(&nwkRxQueue, frame);
+}
+#endif
+
+#ifdef NWK_ENABLE_STATISTICS
+/*****************************************************************************
+*****************************************************************************/
+void NWK_GetDuplicateStats(NWK_DuplicateStats_t *stats)
+{
+  *stats = nwkRxDuplicateStats;
+}
+
+#ifdef NWK_ENABLE_SECURITY
+/*****************************************************************************
+*****************************************************************************/
+void NWK_GetSecurityStats(NWK_SecurityStats_t *stats)
+{
+  *stats = nwkRxSecurityStats;
+}
+
+/*****************************************************************************
+*****************************************************************************/
+static void nwkRxSecurityDropped(NwkFrame_t *frame)
+{
+  uint8_t overhead = nwkFrameHeaderSize(frame) + NWK_SECURITY_MIC_SIZE;
+
+  if (frame->size > overhead)
+    nwkRxSecurityStats.savedBlocks += (frame->size - overhead + NWK_SECURITY_BLOCK_SIZE - 1) /
+        NWK_SECURITY_BLOCK_SIZE;
 }
 #endif
+#endif
 
 /*****************************************************************************
 *****************************************************************************/
 static void nwkRxDuplicateRejectionTimerHandler(SYS_Timer_t *timer)
 {
-  bool restart = false;
+  uint16_t time = SYS_TimerGetTime() >> NWK_RX_DUPLICATE_REJECTION_TICK;
+  bool active = false;
 
   for (uint8_t i = 0; i < NWK_DUPLICATE_REJECTION_TABLE_SIZE; i++)
   {
-    if (nwkRxDuplicateRejectionTable[i].ttl)
-    {
-      nwkRxDuplicateRejectionTable[i].ttl--;
-      restart = true;
-    }
+    NwkDuplicateRejectionRecord_t *rec = &nwkRxDuplicateRejectionTable[i];
+
+    if (0xffff == rec->src)
+      continue;
+
+    if ((uint16_t)(time - rec->time) > NWK_RX_DUPLICATE_REJECTION_TTL)
+      rec->src = 0xffff;
+    else
+      active = true;
   }
 
-  if (restart)
+  // The timer stops with the last record and starts again with a new one
+  if (active)
     SYS_TimerStart(timer);
 }
 
+/*****************************************************************************
+*****************************************************************************/
+static NwkDuplicateRejectionRecord_t *nwkRxDuplicateRecord(NwkFrameHeader_t *header)
+{
+  uint16_t time = SYS_TimerGetTime() >> NWK_RX_DUPLICATE_REJECTION_TICK;
+  uint8_t index;
+
+  index = (uint8_t)(header->nwkSrcAddr ^ (header->nwkSrcAddr >> 8)) % NWK_DUPLICATE_REJECTION_TABLE_SIZE;
+
+  for (uint8_t i = 0; i < NWK_RX_DUPLICATE_REJECTION_PROBES; i++)
+  {
+    NwkDuplicateRejectionRecord_t *rec = &nwkRxDuplicateRejectionTable[index];
+
+    if (header->nwkSrcAddr == rec->src && header->nwkSeq == rec->seq &&
+        (uint16_t)(time - rec->time) <= NWK_RX_DUPLICATE_REJECTION_TTL)
+      return rec;
+
+    if (++index == NWK_DUPLICATE_REJECTION_TABLE_SIZE)
+      index = 0;
+  }
+
+  return NULL;
+}
+
 /*****************************************************************************
 *****************************************************************************/
 static bool nwkRxRejectDuplicate(NwkFrameHeader_t *header)
 {
-  int8_t free = -1;
+  NwkDuplicateRejectionRecord_t *rec = NULL;
+  NwkDuplicateRejectionRecord_t *victim = NULL;
+  uint16_t time = SYS_TimerGetTime() >> NWK_RX_DUPLICATE_REJECTION_TICK;
+  uint16_t oldest = 0;
+  uint8_t index;
 
-  for (uint8_t i = 0; i < NWK_DUPLICATE_REJECTION_TABLE_SIZE; i++)
+  index = (uint8_t)(header->nwkSrcAddr ^ (header->nwkSrcAddr >> 8)) % NWK_DUPLICATE_REJECTION_TABLE_SIZE;
+
+  // Open addressing with a bounded probe sequence. A new source takes an
+  // empty or expired record, or evicts the least recently updated one.
+  for (uint8_t i = 0; i < NWK_RX_DUPLICATE_REJECTION_PROBES; i++)
   {
-    if (nwkRxDuplicateRejectionTable[i].ttl)
-    {
-      if (header->nwkSrcAddr == nwkRxDuplicateRejectionTable[i].src)
-      {
-        int8_t diff = (int8_t)header->nwkSeq - nwkRxDuplicateRejectionTable[i].seq;
+    NwkDuplicateRejectionRecord_t *r = &nwkRxDuplicateRejectionTable[index];
+    uint16_t age = (0xffff == r->src) ? UINT16_MAX : (uint16_t)(time - r->time);
 
-        if (diff > 0)
-        {
-          nwkRxDuplicateRejectionTable[i].seq = header->nwkSeq;
-          nwkRxDuplicateRejectionTable[i].ttl = DUPLICATE_REJECTION_TTL;
-          return false;
-        }
-        else
-        {
-#ifdef NWK_ENABLE_ROUTING
-          if (nwkIb.addr == header->macDstAddr)
-            nwkRouteRemove(header->nwkDstAddr);
-#endif
-          return true;
-        }
-      }
+    if (header->nwkSrcAddr == r->src)
+    {
+      if (age <= NWK_RX_DUPLICATE_REJECTION_TTL)
+        rec = r;
+      else
+        victim = r; // The window has aged out, it starts again in place
+      break;
     }
-    else // ttl == 0
+
+    if (NULL == victim || age > oldest)
     {
-      free = i;
+      victim = r;
+      oldest = age;
     }
+
+    if (++index == NWK_DUPLICATE_REJECTION_TABLE_SIZE)
+      index = 0;
   }
 
-  if (-1 == free)
+  if (rec)
+  {
+    int8_t diff = (int8_t)(header->nwkSeq - rec->seq);
+
+    if (diff > 0)
+    {
+      rec->window = (diff < NWK_RX_DUPLICATE_REJECTION_WINDOW) ? (rec->window << diff) | 1 : 1;
+      rec->seq = header->nwkSeq;
+      rec->macSeq = header->macSeq;
+      rec->retry = header->nwkFcf.retry;
+      rec->acked = false;
+      rec->time = time;
+      return false;
+    }
+
+    // Retries keep the sequence number, only the destination rejects them
+    if (0 == diff && header->nwkFcf.retry > rec->retry &&
+        nwkIb.addr != header->nwkDstAddr)
+    {
+      rec->macSeq = header->macSeq;
+      rec->retry = header->nwkFcf.retry;
+      rec->time = time;
+      return false;
+    }
+
+    // Late, but not seen yet
+    if (-diff < NWK_RX_DUPLICATE_REJECTION_WINDOW &&
+        0 == (rec->window & ((uint32_t)1 << -diff)))
+    {
+      rec->window |= (uint32_t)1 << -diff;
+      rec->macSeq = header->macSeq;
+      rec->time = time;
+      return false;
+    }
+
+#ifdef NWK_ENABLE_ROUTING
+    // A relayed frame that comes back with a new MAC sequence number went
+    // around a loop, the same MAC sequence number is a MAC retransmission
+    if (nwkIb.addr == header->macDstAddr && nwkIb.addr != header->nwkDstAddr &&
+        rec->macSeq != header->macSeq)
+      nwkRouteRemove(header->nwkDstAddr);
+#endif
+
+#ifdef NWK_ENABLE_STATISTICS
+    ++nwkRxDuplicateStats.rejected;
+#endif
     return true;
+  }
 
-  nwkRxDuplicateRejectionTable[free].src = header->nwkSrcAddr;
-  nwkRxDuplicateRejectionTable[free].seq = header->nwkSeq;
-  nwkRxDuplicateRejectionTable[free].ttl = DUPLICATE_REJECTION_TTL;
+#ifdef NWK_ENABLE_STATISTICS
+  if (victim->src != header->nwkSrcAddr && oldest <= NWK_RX_DUPLICATE_REJECTION_TTL)
+    ++nwkRxDuplicateStats.evicted;
+#endif
+
+  victim->src = header->nwkSrcAddr;
+  victim->seq = header->nwkSeq;
+  victim->macSeq = header->macSeq;
+  victim->retry = header->nwkFcf.retry;
+  victim->acked = false;
+  victim->window = 1;
+  victim->time = time;
 
   SYS_TimerStart(&nwkRxDuplicateRejectionTimer);
 
@@ -262,6 +429,20 @@ static bool nwkRxSeriveDataInd(NWK_DataInd_t *ind)
 #ifdef NWK_ENABLE_ROUTING
   else if (NWK_COMMAND_ROUTE_ERROR == cmd)
     nwkRouteErrorReceived(ind);
+#endif
+#ifdef NWK_ENABLE_ROUTE_DISCOVERY
+  else if (NWK_COMMAND_ROUTE_REQUEST == cmd)
+    nwkRouteDiscoveryRequestReceived(ind);
+  else if (NWK_COMMAND_ROUTE_REPLY == cmd)
+    nwkRouteDiscoveryReplyReceived(ind);
+#endif
+#if NWK_SOURCE_ROUTE_TABLE_SIZE > 0
+  else if (NWK_COMMAND_ROUTE_RECORD == cmd)
+    nwkSourceRouteRecordReceived(ind);
+#endif
+#ifdef NWK_ENABLE_COLLECTION
+  else if (NWK_COMMAND_COLLECTION_BEACON == cmd)
+    nwkCollectionBeaconReceived(ind);
 #endif
   else
     return false;
@@ -269,22 +450,38 @@ static bool nwkRxSeriveDataInd(NWK_DataInd_t *ind)
   return true;
 }
 
+/*****************************************************************************
+*****************************************************************************/
+static inline bool nwkRxEndpointOpen(NwkFrameHeader_t *header)
+{
+  return header->nwkDstEndpoint < NWK_MAX_ENDPOINTS_AMOUNT &&
+      NULL != nwkIb.endpoint[header->nwkDstEndpoint];
+}
+
+/*****************************************************************************
+*****************************************************************************/
+static inline bool nwkRxForceAck(NwkFrameHeader_t *header)
+{
+  return 0xffff == header->macDstAddr && nwkIb.addr == header->nwkDstAddr &&
+      0 == header->nwkFcf.multicast;
+}
+
 /*****************************************************************************
 *****************************************************************************/
 static bool nwkRxIndicateFrame(NwkFrame_t *frame)
 {
   NwkFrameHeader_t *header = &frame->data.header;
+  uint8_t headerSize = nwkFrameHeaderSize(frame);
   NWK_DataInd_t ind;
 
-  if (header->nwkDstEndpoint > NWK_MAX_ENDPOINTS_AMOUNT || 
-      NULL == nwkIb.endpoint[header->nwkDstEndpoint])
+  if (!nwkRxEndpointOpen(header))
     return false;
 
   ind.srcAddr = header->nwkSrcAddr;
   ind.srcEndpoint = header->nwkSrcEndpoint;
   ind.dstEndpoint = header->nwkDstEndpoint;
-  ind.data = frame->data.payload;
-  ind.size = frame->size - sizeof(NwkFrameHeader_t);
+  ind.data = (uint8_t *)&frame->data + headerSize;
+  ind.size = frame->size - headerSize;
   ind.lqi = frame->rx.lqi;
   ind.rssi = frame->rx.rssi;
 
@@ -292,12 +489,63 @@ static bool nwkRxIndicateFrame(NwkFrame_t *frame)
   ind.options |= (header->nwkFcf.securityEnabled) ? NWK_IND_OPT_SECURED : 0;
   ind.options |= (header->nwkFcf.linkLocal) ? NWK_IND_OPT_LINK_LOCAL : 0;
   ind.options |= (0xffff == header->nwkDstAddr) ? NWK_IND_OPT_BROADCAST : 0;
+  ind.options |= (header->nwkFcf.multicast) ? NWK_IND_OPT_MULTICAST : 0;
   ind.options |= (header->nwkSrcAddr == header->macSrcAddr) ? NWK_IND_OPT_LOCAL : 0;
   ind.options |= (0xffff == header->macDstPanId) ? NWK_IND_OPT_BROADCAST_PAN_ID : 0;
 
   return nwkIb.endpoint[header->nwkDstEndpoint](&ind);
 }
 
+/*****************************************************************************
+*****************************************************************************/
+static bool nwkRxDeliverFrame(NwkFrameHeader_t *header)
+{
+#ifdef NWK_ENABLE_MULTICAST
+  // Group frames are relayed by every node, but only members decrypt and
+  // indicate them
+  if (header->nwkFcf.multicast)
+    return NWK_GroupIsMember(header->nwkDstAddr);
+#endif
+
+  return nwkIb.addr == header->nwkDstAddr || 0xffff == header->nwkDstAddr;
+}
+
+#ifdef NWK_ENABLE_SECURITY
+/*****************************************************************************
+*****************************************************************************/
+static bool nwkRxDecryptFrame(NwkFrame_t *frame)
+{
+  NwkFrameHeader_t *header = &frame->data.header;
+
+  // The AES work is only spent on frames that can be indicated. Frames
+  // that must be acknowledged regardless of the endpoint are kept.
+  if (!nwkRxEndpointOpen(header) && !nwkRxForceAck(header))
+  {
+#ifdef NWK_ENABLE_STATISTICS
+    ++nwkRxSecurityStats.noEndpoint;
+    nwkRxSecurityDropped(frame);
+#endif
+    return false;
+  }
+
+  // Without free buffers the reception of any frame fails, so broadcast and
+  // group frames, which are never acknowledged, give way
+  if (nwkIb.addr != header->nwkDstAddr && nwkFramePoolExhausted())
+  {
+#ifdef NWK_ENABLE_STATISTICS
+    ++nwkRxSecurityStats.pressure;
+    nwkRxSecurityDropped(frame);
+#endif
+    return false;
+  }
+
+#ifdef NWK_ENABLE_STATISTICS
+  ++nwkRxSecurityStats.decrypted;
+#endif
+  return true;
+}
+#endif
+
 /*****************************************************************************
 *****************************************************************************/
 static void nwkRxHandleReceivedFrame(NwkFrame_t *frame)
@@ -306,7 +554,7 @@ static void nwkRxHandleReceivedFrame(NwkFrame_t *frame)
 
   frame->state = NWK_RX_STATE_FINISH;
 
-  if ((0xffff == header->nwkDstAddr && header->nwkFcf.ackRequest) ||
+  if (((0xffff == header->nwkDstAddr || header->nwkFcf.multicast) && header->nwkFcf.ackRequest) ||
       (nwkIb.addr == header->nwkSrcAddr))
     return;
 
@@ -315,22 +563,68 @@ static void nwkRxHandleReceivedFrame(NwkFrame_t *frame)
     return;
 #endif
 
+#ifndef NWK_ENABLE_MULTICAST
+  if (header->nwkFcf.multicast)
+    return;
+#endif
+
+#ifdef NWK_ENABLE_SOURCE_ROUTING
+  if (header->nwkFcf.sourceRoute && !nwkSourceRouteFrameCheck(frame))
+    return;
+#else
+  if (header->nwkFcf.sourceRoute)
+    return;
+#endif
+
+#ifdef NWK_ENABLE_SECURITY
+  // The security engine relies on the MIC following the header
+  if (header->nwkFcf.securityEnabled &&
+      frame->size < nwkFrameHeaderSize(frame) + NWK_SECURITY_MIC_SIZE)
+    return;
+#endif
+
 #ifdef NWK_ENABLE_ROUTING
   nwkRouteFrameReceived(frame);
 #endif
 
+  // Replayed frames are rejected before any decryption
   if (nwkRxRejectDuplicate(header))
+  {
+    NwkDuplicateRejectionRecord_t *rec;
+
+    // A retry means that the ACK for the first copy was lost. Only a copy
+    // that was indicated and acknowledged is acknowledged again, with the
+    // same control value.
+    if (nwkIb.addr == header->nwkDstAddr && header->nwkFcf.ackRequest &&
+        NULL != (rec = nwkRxDuplicateRecord(header)) && rec->acked)
+    {
+      nwkRxAckControl = rec->ackControl;
+      nwkRxSendAck(frame);
+    }
+
+#if defined(NWK_ENABLE_SECURITY) && defined(NWK_ENABLE_STATISTICS)
+    if (header->nwkFcf.securityEnabled && nwkRxDeliverFrame(header))
+    {
+      ++nwkRxSecurityStats.duplicate;
+      nwkRxSecurityDropped(frame);
+    }
+#endif
     return;
+  }
 
-  if (0xffff == header->macDstAddr && nwkIb.addr != header->nwkDstAddr &&
-      0xffff != header->macDstPanId && 0 == header->nwkFcf.linkLocal)
+  if (0xffff == header->macDstAddr && 0xffff != header->macDstPanId &&
+      (nwkIb.addr != header->nwkDstAddr || header->nwkFcf.multicast) &&
+      0 == header->nwkFcf.linkLocal)
     nwkTxBroadcastFrame(frame);
 
-  if (nwkIb.addr == header->nwkDstAddr || 0xffff == header->nwkDstAddr)
+  if (nwkRxDeliverFrame(header))
   {
 #ifdef NWK_ENABLE_SECURITY
     if (header->nwkFcf.securityEnabled)
-      frame->state = NWK_RX_STATE_DECRYPT;
+    {
+      if (nwkRxDecryptFrame(frame))
+        frame->state = NWK_RX_STATE_DECRYPT;
+    }
     else
 #endif
       frame->state = NWK_RX_STATE_INDICATE;
@@ -347,20 +641,18 @@ static void nwkRxHandleReceivedFrame(NwkFrame_t *frame)
 *****************************************************************************/
 void nwkRxTaskHandler(void)
 {
+  NwkFrame_t *frame;
+
   if (0 == nwkRxActiveFrames)
     return;
 
-  for (int i = 0; i < NWK_BUFFERS_AMOUNT; i++)
+  while (NULL != (frame = nwkFrameQueuePop(&nwkRxQueue)))
   {
-    NwkFrame_t *frame = nwkFrameByIndex(i);
+    if (NWK_RX_STATE_RECEIVED == frame->state)
+      nwkRxHandleReceivedFrame(frame);
 
     switch (frame->state)
     {
-      case NWK_RX_STATE_RECEIVED:
-      {
-        nwkRxHandleReceivedFrame(frame);
-      } break;
-
 #ifdef NWK_ENABLE_SECURITY
       case NWK_RX_STATE_DECRYPT:
       {
@@ -375,12 +667,23 @@ void nwkRxTaskHandler(void)
 
         nwkRxAckControl = NWK_ACK_CONTROL_NONE;
         ack = nwkRxIndicateFrame(frame);
-        forceAck = (0xffff == header->macDstAddr && nwkIb.addr == header->nwkDstAddr);
+        forceAck = nwkRxForceAck(header);
 
         if ((header->nwkFcf.ackRequest && ack) || forceAck)
+        {
+          NwkDuplicateRejectionRecord_t *rec = nwkRxDuplicateRecord(header);
+
+          if (rec)
+          {
+            rec->acked = true;
+            rec->ackControl = nwkRxAckControl;
+          }
+
           nwkRxSendAck(frame);
+        }
 
-        frame->state = NWK_RX_STATE_FINISH;
+        nwkFrameFree(frame);
+        --nwkRxActiveFrames;
       } break;
 
 #ifdef NWK_ENABLE_ROUTING
@@ -61,91 +61,195 @@ enum
   NWK_SECURITY_STATE_CONFIRM         = 0x34,
 };
 
+/*****************************************************************************
+*****************************************************************************/
+// Encryption and decryption run in separate contexts, so they interleave,
+// while each direction keeps the order of its frames
+enum
+{
+  NWK_SECURITY_CONTEXT_ENCRYPT = 0,
+  NWK_SECURITY_CONTEXT_DECRYPT = 1,
+  NWK_SECURITY_CONTEXTS_AMOUNT = 2,
+};
+
+typedef struct NwkSecurityContext_t
+{
+  NwkFrame_t       *frame;
+  NwkFrameQueue_t  queue;
+  uint32_t         vector[4];
+  uint32_t         key[4];
+  uint8_t          size;
+  uint8_t          offset;
+} NwkSecurityContext_t;
+
 /*****************************************************************************
 *****************************************************************************/
 static uint8_t nwkSecurityActiveFrames;
-static NwkFrame_t *nwkSecurityActiveFrame;
-static uint8_t nwkSecuritySize;
-static uint8_t nwkSecurityOffset;
-static bool nwkSecurityEncrypt;
-static uint32_t nwkSecurityVector[4];
+static NwkSecurityContext_t nwkSecurityContexts[NWK_SECURITY_CONTEXTS_AMOUNT];
+static NwkSecurityContext_t *nwkSecurityPendingContext;
+static NwkSecurityContext_t *nwkSecurityLastContext;
+static uint8_t nwkSecurityNextContext;
 
 /*****************************************************************************
 *****************************************************************************/
 void nwkSecurityInit(void)
 {
   nwkSecurityActiveFrames = 0;
-  nwkSecurityActiveFrame = NULL;
+  nwkSecurityPendingContext = NULL;
+  nwkSecurityLastContext = NULL;
+  nwkSecurityNextContext = 0;
+
+  for (uint8_t i = 0; i < NWK_SECURITY_CONTEXTS_AMOUNT; i++)
+  {
+    nwkSecurityContexts[i].frame = NULL;
+    nwkFrameQueueInit(&nwkSecurityContexts[i].queue);
+  }
 }
 
 /*****************************************************************************
 *****************************************************************************/
 void nwkSecurityProcess(NwkFrame_t *frame, bool encrypt)
 {
+  NwkSecurityContext_t *ctx;
+
   if (encrypt)
+  {
     frame->state = NWK_SECURITY_STATE_ENCRYPT_PENDING;
+    ctx = &nwkSecurityContexts[NWK_SECURITY_CONTEXT_ENCRYPT];
+  }
   else
+  {
     frame->state = NWK_SECURITY_STATE_DECRYPT_PENDING;
+    ctx = &nwkSecurityContexts[NWK_SECURITY_CONTEXT_DECRYPT];
+  }
+
+  nwkFrameQueuePush(&ctx->queue, frame);
   ++nwkSecurityActiveFrames;
 }
 
 /*****************************************************************************
 *****************************************************************************/
-static void nwkSecurityStart(void)
+static uint8_t *nwkSecurityKey(NwkFrameHeader_t *header)
+{
+#if NWK_LINK_KEY_TABLE_SIZE > 0
+  uint16_t peer = (nwkIb.addr == header->nwkSrcAddr) ? header->nwkDstAddr : header->nwkSrcAddr;
+  uint8_t *key;
+
+  if (0xffff != header->nwkDstAddr && 0 == header->nwkFcf.multicast &&
+      NULL != (key = nwkLinkKeyGet(peer)))
+    return key;
+#else
+  (void)header;
+#endif
+
+  return (uint8_t *)nwkIb.key;
+}
+
+/*****************************************************************************
+*****************************************************************************/
+static void nwkSecurityStart(NwkSecurityContext_t *ctx)
 {
-  NwkFrameHeader_t *header = &nwkSecurityActiveFrame->data.header;
+  NwkFrameHeader_t *header;
 
-  nwkSecurityVector[0] = header->nwkSeq;
-  nwkSecurityVector[1] = ((uint32_t)header->nwkDstAddr << 16) | header->nwkDstEndpoint;
-  nwkSecurityVector[2] = ((uint32_t)header->nwkSrcAddr << 16) | header->nwkSrcEndpoint;
-  nwkSecurityVector[3] = ((uint32_t)header->macDstPanId << 16) | *(uint8_t *)&header->nwkFcf;
+  if (NULL == (ctx->frame = nwkFrameQueuePop(&ctx->queue)))
+    return;
+
+  header = &ctx->frame->data.header;
+
+  ctx->vector[0] = header->nwkSeq;
+  ctx->vector[1] = ((uint32_t)header->nwkDstAddr << 16) | header->nwkDstEndpoint;
+  ctx->vector[2] = ((uint32_t)header->nwkSrcAddr << 16) | header->nwkSrcEndpoint;
+  ctx->vector[3] = ((uint32_t)header->macDstPanId << 16) | *(uint8_t *)&header->nwkFcf;
+  // The key is copied, so changes to the key tables do not affect frames
+  // in progress
+  memcpy((uint8_t *)ctx->key, nwkSecurityKey(header), NWK_SECURITY_KEY_SIZE);
 
-  nwkSecuritySize = nwkSecurityActiveFrame->size - sizeof(NwkFrameHeader_t) - NWK_SECURITY_MIC_SIZE;
-  nwkSecurityOffset = 0;
-  nwkSecurityEncrypt = (NWK_SECURITY_STATE_ENCRYPT_PENDING == nwkSecurityActiveFrame->state);
+  // A source route stays in clear text, relays have to read it
+  ctx->offset = nwkFrameHeaderSize(ctx->frame) - sizeof(NwkFrameHeader_t);
+  ctx->size = ctx->frame->size - sizeof(NwkFrameHeader_t) - ctx->offset - NWK_SECURITY_MIC_SIZE;
 
-  nwkSecurityActiveFrame->state = NWK_SECURITY_STATE_PROCESS;
+  ctx->frame->state = NWK_SECURITY_STATE_PROCESS;
 }
 
+/*****************************************************************************
+*****************************************************************************/
+static void nwkSecurityEncryptBlock(NwkSecurityContext_t *ctx)
+{
+  nwkSecurityPendingContext = ctx;
+  nwkSecurityLastContext = ctx;
+  ctx->frame->state = NWK_SECURITY_STATE_WAIT;
+  SYS_EncryptReq((uint8_t *)ctx->vector, (uint8_t *)ctx->key);
+}
+
+#if SYS_SECURITY_MODE == 0
+/*****************************************************************************
+*****************************************************************************/
+static NwkSecurityContext_t *nwkSecurityChainContext(NwkSecurityContext_t *ctx)
+{
+  NwkSecurityContext_t *encrypt = &nwkSecurityContexts[NWK_SECURITY_CONTEXT_ENCRYPT];
+  NwkSecurityContext_t *other = (ctx == encrypt) ? &nwkSecurityContexts[NWK_SECURITY_CONTEXT_DECRYPT] : encrypt;
+
+  if (other->frame && NWK_SECURITY_STATE_PROCESS == other->frame->state &&
+      0 == memcmp(other->key, ctx->key, NWK_SECURITY_KEY_SIZE))
+    return other;
+
+  if (NWK_SECURITY_STATE_PROCESS == ctx->frame->state)
+    return ctx;
+
+  return NULL;
+}
+#endif
+
 /*****************************************************************************
 *****************************************************************************/
 void SYS_EncryptConf(void)
 {
-  uint8_t *vector = (uint8_t *)nwkSecurityVector;
-  uint8_t *text = &nwkSecurityActiveFrame->data.payload[nwkSecurityOffset];
+  NwkSecurityContext_t *ctx = nwkSecurityPendingContext;
+  bool encrypt = (ctx == &nwkSecurityContexts[NWK_SECURITY_CONTEXT_ENCRYPT]);
+  uint8_t *vector = (uint8_t *)ctx->vector;
+  uint8_t *text = &ctx->frame->data.payload[ctx->offset];
   uint8_t block;
 
-  block = (nwkSecuritySize < NWK_SECURITY_BLOCK_SIZE) ? nwkSecuritySize : NWK_SECURITY_BLOCK_SIZE;
+  block = (ctx->size < NWK_SECURITY_BLOCK_SIZE) ? ctx->size : NWK_SECURITY_BLOCK_SIZE;
 
   for (uint8_t i = 0; i < block; i++)
   {
     text[i] ^= vector[i];
 
-    if (nwkSecurityEncrypt)
+    if (encrypt)
       vector[i] = text[i];
     else
       vector[i] ^= text[i];
   }
 
-  nwkSecurityOffset += block;
-  nwkSecuritySize -= block;
+  ctx->offset += block;
+  ctx->size -= block;
 
-  if (nwkSecuritySize > 0)
-    nwkSecurityActiveFrame->state = NWK_SECURITY_STATE_PROCESS;
+  if (ctx->size > 0)
+    ctx->frame->state = NWK_SECURITY_STATE_PROCESS;
   else
-    nwkSecurityActiveFrame->state = NWK_SECURITY_STATE_CONFIRM;
+    ctx->frame->state = NWK_SECURITY_STATE_CONFIRM;
+
+  nwkSecurityPendingContext = NULL;
+
+#if SYS_SECURITY_MODE == 0
+  // The PHY confirms from its own task handler. The next block of a frame
+  // in progress is requested from here, so the PHY starts it in the same
+  // call. Frames are started and completed by the task handler only.
+  if (NULL != (ctx = nwkSecurityChainContext(ctx)))
+    nwkSecurityEncryptBlock(ctx);
+#endif
 }
 
 /*****************************************************************************
 *****************************************************************************/
-static bool nwkSecurityProcessMic(void)
+static bool nwkSecurityProcessMic(NwkSecurityContext_t *ctx, bool encrypt)
 {
-  uint8_t *mic = &nwkSecurityActiveFrame->data.payload[nwkSecurityOffset];
-  uint32_t vmic = nwkSecurityVector[0] ^ nwkSecurityVector[1] ^
-                  nwkSecurityVector[2] ^ nwkSecurityVector[3];
+  uint8_t *mic = &ctx->frame->data.payload[ctx->offset];
+  uint32_t vmic = ctx->vector[0] ^ ctx->vector[1] ^ ctx->vector[2] ^ ctx->vector[3];
   uint32_t tmic;
 
-  if (nwkSecurityEncrypt)
+  if (encrypt)
   {
     memcpy(mic, (uint8_t *)&vmic, NWK_SECURITY_MIC_SIZE);
     return true;
@@ -159,46 +263,74 @@ static bool nwkSecurityProcessMic(void)
 
 /*****************************************************************************
 *****************************************************************************/
-void nwkSecurityTaskHandler(void)
+static void nwkSecurityComplete(NwkSecurityContext_t *ctx)
 {
-  if (0 == nwkSecurityActiveFrames)
-    return;
+  NwkFrame_t *frame = ctx->frame;
+  bool encrypt = (ctx == &nwkSecurityContexts[NWK_SECURITY_CONTEXT_ENCRYPT]);
+  bool micStatus = nwkSecurityProcessMic(ctx, encrypt);
 
-  if (nwkSecurityActiveFrame)
-  {
-    if (NWK_SECURITY_STATE_CONFIRM == nwkSecurityActiveFrame->state)
-    {
-      bool micStatus = nwkSecurityProcessMic();
+  // The context is free before the callbacks, they may queue the frame again
+  ctx->frame = NULL;
+  --nwkSecurityActiveFrames;
 
-      if (nwkSecurityEncrypt)
-        nwkTxEncryptConf(nwkSecurityActiveFrame);
-      else
-        nwkRxDecryptConf(nwkSecurityActiveFrame, micStatus);
+  if (encrypt)
+    nwkTxEncryptConf(frame);
+  else if (nwkIb.addr == frame->data.header.nwkSrcAddr)
+    nwkTxDecryptConf(frame);
+  else
+    nwkRxDecryptConf(frame, micStatus);
+}
 
-      nwkSecurityActiveFrame = NULL;
-      --nwkSecurityActiveFrames;
-    }
-    else if (NWK_SECURITY_STATE_PROCESS == nwkSecurityActiveFrame->state)
-    {
-      nwkSecurityActiveFrame->state = NWK_SECURITY_STATE_WAIT;
-      SYS_EncryptReq((uint8_t *)nwkSecurityVector, (uint8_t *)nwkIb.key);
-    }
+/*****************************************************************************
+*****************************************************************************/
+static NwkSecurityContext_t *nwkSecurityReadyContext(void)
+{
+  for (uint8_t i = 0; i < NWK_SECURITY_CONTEXTS_AMOUNT; i++)
+  {
+    NwkSecurityContext_t *ctx = &nwkSecurityContexts[nwkSecurityNextContext];
 
-    return;
-  }
+    if (++nwkSecurityNextContext == NWK_SECURITY_CONTEXTS_AMOUNT)
+      nwkSecurityNextContext = 0;
 
-  for (int i = 0; i < NWK_BUFFERS_AMOUNT; i++)
-  {
-    NwkFrame_t *frame = nwkFrameByIndex(i);
+    if (ctx->frame && NWK_SECURITY_STATE_CONFIRM == ctx->frame->state)
+      nwkSecurityComplete(ctx);
+
+    if (NULL == ctx->frame)
+      nwkSecurityStart(ctx);
 
-    if (NWK_SECURITY_STATE_ENCRYPT_PENDING == frame->state ||
-        NWK_SECURITY_STATE_DECRYPT_PENDING == frame->state)
+    if (ctx->frame && NWK_SECURITY_STATE_PROCESS == ctx->frame->state)
     {
-      nwkSecurityActiveFrame = frame;
-      nwkSecurityStart();
-      return;
+      NwkSecurityContext_t *last = nwkSecurityLastContext;
+
+      // Blocks of frames with different keys are not interleaved, the
+      // engine would have to load the key again for every block
+      if (last && last != ctx && last->frame &&
+          NWK_SECURITY_STATE_PROCESS == last->frame->state &&
+          memcmp(last->key, ctx->key, NWK_SECURITY_KEY_SIZE))
+        continue;
+
+      return ctx;
     }
   }
+
+  return NULL;
+}
+
+/*****************************************************************************
+*****************************************************************************/
+void nwkSecurityTaskHandler(void)
+{
+  NwkSecurityContext_t *ctx;
+
+  if (0 == nwkSecurityActiveFrames)
+    return;
+
+  // Contexts take turns block by block. A synchronous backend confirms
+  // inside SYS_EncryptReq(), so the blocks run back-to-back until all
+  // frames are done. An asynchronous one leaves the request pending and
+  // requests the following blocks of the same frames from SYS_EncryptConf().
+  while (NULL == nwkSecurityPendingContext && NULL != (ctx = nwkSecurityReadyContext()))
+    nwkSecurityEncryptBlock(ctx);
 }
 
 #endif // NWK_ENABLE_SECURITY
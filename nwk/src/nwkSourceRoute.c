@@ -0,0 +1,409 @@
+/**
+ * \file nwkSourceRoute.c
+ *
+ * \brief Source routing implementation
+ *
+ * Copyright (C) 2012 Atmel Corporation. All rights reserved.
+ *
+ * \asf_license_start
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. The name of Atmel may not be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * 4. This software may only be redistributed and used in connection with an
+ *    Atmel microcontroller product.
+ *
+ * THIS SOFTWARE IS PROVIDED BY ATMEL "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT ARE
+ * EXPRESSLY AND SPECIFICALLY DISCLAIMED. IN NO EVENT SHALL ATMEL BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * \asf_license_stop
+ *
+ * $Id$
+ *
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "nwk.h"
+#include "nwkPrivate.h"
+#include "sysTimer.h"
+
+#ifdef NWK_ENABLE_SOURCE_ROUTING
+
+/*****************************************************************************
+*****************************************************************************/
+#define NWK_SOURCE_ROUTE_UNKNOWN           0xffff
+#define NWK_SOURCE_ROUTE_RECORD_OVERFLOW   0xff
+
+#if NWK_SOURCE_ROUTE_TABLE_SIZE > 0
+
+#define NWK_SOURCE_ROUTE_NONE              0xffff
+
+// Power of 2, about two records per bucket
+#if NWK_SOURCE_ROUTE_TABLE_SIZE <= 16
+  #define NWK_SOURCE_ROUTE_HASH_SIZE       8
+#elif NWK_SOURCE_ROUTE_TABLE_SIZE <= 256
+  #define NWK_SOURCE_ROUTE_HASH_SIZE       128
+#else
+  #define NWK_SOURCE_ROUTE_HASH_SIZE       1024
+#endif
+
+/*****************************************************************************
+*****************************************************************************/
+typedef struct NwkSourceRouteRecord_t
+{
+  uint16_t   dst;
+  uint16_t   hashNext;
+  uint32_t   time;
+  uint8_t    hops;
+  uint16_t   relay[NWK_SOURCE_ROUTE_MAX_HOPS]; // from the coordinator
+} NwkSourceRouteRecord_t;
+
+#endif // NWK_SOURCE_ROUTE_TABLE_SIZE > 0
+
+/*****************************************************************************
+*****************************************************************************/
+static void nwkSourceRouteRecordConf(NwkFrame_t *frame);
+
+/*****************************************************************************
+*****************************************************************************/
+static uint16_t nwkSourceRouteRecordHop;
+static uint32_t nwkSourceRouteRecordTime;
+#if NWK_SOURCE_ROUTE_TABLE_SIZE > 0
+static NwkSourceRouteRecord_t nwkSourceRouteTable[NWK_SOURCE_ROUTE_TABLE_SIZE];
+static uint16_t nwkSourceRouteHash[NWK_SOURCE_ROUTE_HASH_SIZE];
+static uint16_t nwkSourceRouteFree;
+#endif
+
+/*****************************************************************************
+*****************************************************************************/
+void nwkSourceRouteInit(void)
+{
+  nwkSourceRouteRecordHop = NWK_SOURCE_ROUTE_UNKNOWN;
+  nwkSourceRouteRecordTime = 0;
+
+#if NWK_SOURCE_ROUTE_TABLE_SIZE > 0
+  for (uint16_t i = 0; i < NWK_SOURCE_ROUTE_TABLE_SIZE; i++)
+  {
+    nwkSourceRouteTable[i].dst = NWK_SOURCE_ROUTE_UNKNOWN;
+    nwkSourceRouteTable[i].hashNext = i + 1;
+  }
+  nwkSourceRouteTable[NWK_SOURCE_ROUTE_TABLE_SIZE - 1].hashNext = NWK_SOURCE_ROUTE_NONE;
+
+  for (uint16_t i = 0; i < NWK_SOURCE_ROUTE_HASH_SIZE; i++)
+    nwkSourceRouteHash[i] = NWK_SOURCE_ROUTE_NONE;
+
+  nwkSourceRouteFree = 0;
+#endif
+}
+
+/*****************************************************************************
+*****************************************************************************/
+bool nwkSourceRouteFrameCheck(NwkFrame_t *frame)
+{
+  NwkFrameHeader_t *header = &frame->data.header;
+  uint8_t size = frame->size - sizeof(NwkFrameHeader_t);
+  uint8_t hops;
+
+  if (0 == size || 0xffff == header->nwkDstAddr || header->nwkFcf.multicast)
+    return false;
+
+  hops = frame->data.payload[0];
+
+  return hops > 0 && hops <= NWK_SOURCE_ROUTE_MAX_HOPS &&
+      size >= sizeof(uint8_t) + hops * sizeof(uint16_t);
+}
+
+/*****************************************************************************
+*****************************************************************************/
+uint16_t nwkSourceRouteNextHop(NwkFrame_t *frame)
+{
+  NwkSourceRouteHeader_t *route = (NwkSourceRouteHeader_t *)frame->data.payload;
+
+  if (nwkIb.addr == frame->data.header.nwkSrcAddr)
+    return route->relay[0];
+
+  // Relays find themselves in the list, so a retransmitted frame needs no
+  // per-hop state
+  for (uint8_t i = 0; i < route->hops; i++)
+  {
+    if (nwkIb.addr == route->relay[i])
+    {
+      if (i + 1 < route->hops)
+        return route->relay[i + 1];
+      return frame->data.header.nwkDstAddr;
+    }
+  }
+
+  return NWK_SOURCE_ROUTE_UNKNOWN;
+}
+
+/*****************************************************************************
+*****************************************************************************/
+void nwkSourceRouteRecordForward(NwkFrame_t *frame)
+{
+  NwkFrameHeader_t *header = &frame->data.header;
+  NwkRouteRecordCommand_t *command = (NwkRouteRecordCommand_t *)frame->data.payload;
+  uint8_t size = frame->size - sizeof(NwkFrameHeader_t);
+  uint8_t capacity;
+
+  if (0 != header->nwkDstEndpoint || header->nwkFcf.securityEnabled ||
+      size < 2 || NWK_COMMAND_ROUTE_RECORD != command->id ||
+      NWK_SOURCE_ROUTE_RECORD_OVERFLOW == command->hops)
+    return;
+
+  // The originator reserves the list, so the frame never grows on the way
+  capacity = (size - 2) / sizeof(uint16_t);
+
+  if (command->hops < capacity)
+    command->relay[command->hops++] = nwkIb.addr;
+  else
+    command->hops = NWK_SOURCE_ROUTE_RECORD_OVERFLOW;
+}
+
+/*****************************************************************************
+*****************************************************************************/
+void nwkSourceRouteRecordUpdate(uint16_t dst)
+{
+  NwkFrame_t *frame;
+  NwkRouteRecordCommand_t *command;
+  uint32_t time = SYS_TimerGetTime();
+  uint16_t nextHop;
+
+  if (NWK_SOURCE_ROUTE_COORDINATOR_ADDR != dst ||
+      NWK_SOURCE_ROUTE_COORDINATOR_ADDR == nwkIb.addr)
+    return;
+
+  // Relays append themselves only to routed frames, so a record sent
+  // without a route would arrive with an incomplete path
+  nextHop = nwkRouteNextHop(dst);
+  if (NWK_SOURCE_ROUTE_UNKNOWN == nextHop)
+    return;
+
+  if (nextHop == nwkSourceRouteRecordHop &&
+      time - nwkSourceRouteRecordTime < NWK_SOURCE_ROUTE_RECORD_INTERVAL)
+    return;
+
+  if (NULL == (frame = nwkFrameAlloc(sizeof(NwkRouteRecordCommand_t))))
+    return;
+
+  nwkFrameCommandInit(frame);
+
+  frame->tx.confirm = nwkSourceRouteRecordConf;
+
+  frame->data.header.nwkDstAddr = dst;
+
+  command = (NwkRouteRecordCommand_t *)frame->data.payload;
+
+  command->id = NWK_COMMAND_ROUTE_RECORD;
+  command->hops = 0;
+
+  nwkSourceRouteRecordHop = nextHop;
+  nwkSourceRouteRecordTime = time;
+
+  nwkTxFrame(frame);
+}
+
+/*****************************************************************************
+*****************************************************************************/
+static void nwkSourceRouteRecordConf(NwkFrame_t *frame)
+{
+  // Send a new record with the next frame if this one did not leave
+  if (NWK_SUCCESS_STATUS != frame->tx.status)
+    nwkSourceRouteRecordHop = NWK_SOURCE_ROUTE_UNKNOWN;
+
+  nwkFrameFree(frame);
+}
+
+#if NWK_SOURCE_ROUTE_TABLE_SIZE > 0
+/*****************************************************************************
+*****************************************************************************/
+static uint16_t *nwkSourceRouteBucket(uint16_t dst)
+{
+  return &nwkSourceRouteHash[(dst ^ (dst >> 8)) & (NWK_SOURCE_ROUTE_HASH_SIZE - 1)];
+}
+
+/*****************************************************************************
+*****************************************************************************/
+static NwkSourceRouteRecord_t *nwkSourceRouteFind(uint16_t dst)
+{
+  uint16_t index = *nwkSourceRouteBucket(dst);
+
+  while (NWK_SOURCE_ROUTE_NONE != index)
+  {
+    if (nwkSourceRouteTable[index].dst == dst)
+      return &nwkSourceRouteTable[index];
+    index = nwkSourceRouteTable[index].hashNext;
+  }
+
+  return NULL;
+}
+
+/*****************************************************************************
+*****************************************************************************/
+static void nwkSourceRouteFreeRecord(NwkSourceRouteRecord_t *rec)
+{
+  uint16_t *bucket = nwkSourceRouteBucket(rec->dst);
+  uint16_t index = rec - nwkSourceRouteTable;
+
+  if (*bucket == index)
+  {
+    *bucket = rec->hashNext;
+  }
+  else
+  {
+    uint16_t prev = *bucket;
+    while (nwkSourceRouteTable[prev].hashNext != index)
+      prev = nwkSourceRouteTable[prev].hashNext;
+    nwkSourceRouteTable[prev].hashNext = rec->hashNext;
+  }
+
+  rec->dst = NWK_SOURCE_ROUTE_UNKNOWN;
+  rec->hashNext = nwkSourceRouteFree;
+  nwkSourceRouteFree = index;
+}
+
+/*****************************************************************************
+*****************************************************************************/
+static NwkSourceRouteRecord_t *nwkSourceRouteNewRecord(uint16_t dst)
+{
+  NwkSourceRouteRecord_t *rec;
+  uint16_t *bucket;
+  uint16_t index;
+
+  // Records arrive rarely, so a full table is searched for the path that
+  // was refreshed the longest time ago
+  if (NWK_SOURCE_ROUTE_NONE == nwkSourceRouteFree)
+  {
+    uint32_t time = SYS_TimerGetTime();
+
+    rec = &nwkSourceRouteTable[0];
+    for (uint16_t i = 1; i < NWK_SOURCE_ROUTE_TABLE_SIZE; i++)
+    {
+      if (time - nwkSourceRouteTable[i].time > time - rec->time)
+        rec = &nwkSourceRouteTable[i];
+    }
+
+    nwkSourceRouteFreeRecord(rec);
+  }
+
+  index = nwkSourceRouteFree;
+  rec = &nwkSourceRouteTable[index];
+  nwkSourceRouteFree = rec->hashNext;
+
+  bucket = nwkSourceRouteBucket(dst);
+  rec->dst = dst;
+  rec->hashNext = *bucket;
+  *bucket = index;
+
+  return rec;
+}
+
+/*****************************************************************************
+*****************************************************************************/
+void nwkSourceRouteRemove(uint16_t dst)
+{
+  NwkSourceRouteRecord_t *rec;
+
+  rec = nwkSourceRouteFind(dst);
+  if (rec)
+    nwkSourceRouteFreeRecord(rec);
+}
+
+/*****************************************************************************
+*****************************************************************************/
+uint8_t nwkSourceRouteSize(uint16_t dst)
+{
+  NwkSourceRouteRecord_t *rec;
+
+  if (0xffff == dst)
+    return 0;
+
+  rec = nwkSourceRouteFind(dst);
+  if (NULL == rec)
+    return 0;
+
+  return sizeof(uint8_t) + rec->hops * sizeof(uint16_t);
+}
+
+/*****************************************************************************
+*****************************************************************************/
+void nwkSourceRouteBuild(NwkFrame_t *frame, uint16_t dst)
+{
+  NwkSourceRouteRecord_t *rec = nwkSourceRouteFind(dst);
+  NwkSourceRouteHeader_t *route = (NwkSourceRouteHeader_t *)frame->data.payload;
+
+  route->hops = rec->hops;
+  memcpy(route->relay, rec->relay, rec->hops * sizeof(uint16_t));
+
+  frame->data.header.nwkFcf.sourceRoute = 1;
+}
+
+/*****************************************************************************
+*****************************************************************************/
+void nwkSourceRouteStrip(NwkFrame_t *frame)
+{
+  uint8_t size = nwkFrameHeaderSize(frame) - sizeof(NwkFrameHeader_t);
+
+  memmove(frame->data.payload, &frame->data.payload[size],
+      frame->size - sizeof(NwkFrameHeader_t) - size);
+
+  frame->size -= size;
+  frame->data.header.nwkFcf.sourceRoute = 0;
+}
+
+/*****************************************************************************
+*****************************************************************************/
+void nwkSourceRouteRecordReceived(NWK_DataInd_t *ind)
+{
+  NwkRouteRecordCommand_t *command = (NwkRouteRecordCommand_t *)ind->data;
+  NwkSourceRouteRecord_t *rec;
+  uint8_t hops;
+
+  if (ind->size < 2)
+    return;
+
+  hops = command->hops;
+
+  // Direct neighbours and paths that do not fit are left to the route table
+  if (0 == hops || hops > NWK_SOURCE_ROUTE_MAX_HOPS ||
+      ind->size < 2 + hops * sizeof(uint16_t))
+  {
+    nwkSourceRouteRemove(ind->srcAddr);
+    return;
+  }
+
+  rec = nwkSourceRouteFind(ind->srcAddr);
+  if (NULL == rec)
+    rec = nwkSourceRouteNewRecord(ind->srcAddr);
+
+  rec->hops = hops;
+  rec->time = SYS_TimerGetTime();
+
+  for (uint8_t i = 0; i < hops; i++)
+    rec->relay[i] = command->relay[hops - 1 - i];
+}
+#endif // NWK_SOURCE_ROUTE_TABLE_SIZE > 0
+
+#endif // NWK_ENABLE_SOURCE_ROUTING
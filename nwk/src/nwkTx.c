@@ -52,30 +52,56 @@
 
 /*****************************************************************************
 *****************************************************************************/
-#define NWK_TX_ACK_WAIT_TIMER_INTERVAL    50 // ms
+#define NWK_TX_BACKOFF_INTERVAL           50 // ms
+#define NWK_TX_MAX_BACKOFF_EXPONENT       5
+#define NWK_TX_MAX_RETRY_NUMBER           3 // nwkFcf.retry is 2 bits wide
+#define NWK_TX_ACK_HASH_SIZE              8 // must be a power of 2
 
 /*****************************************************************************
 *****************************************************************************/
 enum
 {
-  NWK_TX_STATE_ENCRYPT   = 0x10,
   NWK_TX_STATE_SEND      = 0x11,
   NWK_TX_STATE_WAIT_CONF = 0x12,
-  NWK_TX_STATE_SENT      = 0x13,
   NWK_TX_STATE_WAIT_ACK  = 0x14,
   NWK_TX_STATE_CONFIRM   = 0x15,
+  NWK_TX_STATE_BACKOFF   = 0x16,
 };
 
+/*****************************************************************************
+*****************************************************************************/
+#if NWK_ACK_RTT_TABLE_SIZE > 0
+typedef struct NwkTxRttRecord_t
+{
+  uint16_t   dst;
+  uint16_t   srtt;   // ms * 8
+  uint16_t   rttvar; // ms * 4
+} NwkTxRttRecord_t;
+#endif
+
 /*****************************************************************************
 *****************************************************************************/
 static void nwkTxBroadcastConf(NwkFrame_t *frame);
+static void nwkTxConfirm(NwkFrame_t *frame);
 static void nwkTxAckWaitTimerHandler(SYS_Timer_t *timer);
 
 /*****************************************************************************
 *****************************************************************************/
 static NwkFrame_t *nwkTxPhyActiveFrame;
 static uint8_t nwkTxActiveFrames;
+static NwkFrameQueue_t nwkTxSendQueue[NWK_TX_CLASSES_AMOUNT];
+static uint8_t nwkTxSkipCount[NWK_TX_CLASSES_AMOUNT];
+#ifdef NWK_ENABLE_STATISTICS
+static NWK_TxClassStats_t nwkTxStats[NWK_TX_CLASSES_AMOUNT];
+#endif
+static NwkFrameQueue_t nwkTxAckWaitQueue;
+static NwkFrameQueue_t nwkTxConfirmQueue;
+static NwkFrame_t *nwkTxAckHash[NWK_TX_ACK_HASH_SIZE];
 static SYS_Timer_t nwkTxAckWaitTimer;
+#if NWK_ACK_RTT_TABLE_SIZE > 0
+static NwkTxRttRecord_t nwkTxRttTable[NWK_ACK_RTT_TABLE_SIZE];
+static uint8_t nwkTxRttReplace;
+#endif
 
 /*****************************************************************************
 *****************************************************************************/
@@ -84,38 +110,202 @@ void nwkTxInit(void)
   nwkTxPhyActiveFrame = NULL;
   nwkTxActiveFrames = 0;
 
-  nwkTxAckWaitTimer.interval = NWK_TX_ACK_WAIT_TIMER_INTERVAL;
+  for (uint8_t i = 0; i < NWK_TX_CLASSES_AMOUNT; i++)
+  {
+    nwkFrameQueueInit(&nwkTxSendQueue[i]);
+    nwkTxSkipCount[i] = 0;
+  }
+
+#ifdef NWK_ENABLE_STATISTICS
+  memset(nwkTxStats, 0, sizeof(nwkTxStats));
+#endif
+
+  nwkFrameQueueInit(&nwkTxAckWaitQueue);
+  memset(nwkTxAckHash, 0, sizeof(nwkTxAckHash));
+  nwkFrameQueueInit(&nwkTxConfirmQueue);
+
+#if NWK_ACK_RTT_TABLE_SIZE > 0
+  for (uint8_t i = 0; i < NWK_ACK_RTT_TABLE_SIZE; i++)
+    nwkTxRttTable[i].dst = 0xffff;
+  nwkTxRttReplace = 0;
+#endif
+
   nwkTxAckWaitTimer.mode = SYS_TIMER_INTERVAL_MODE;
   nwkTxAckWaitTimer.handler = nwkTxAckWaitTimerHandler;
 }
 
 /*****************************************************************************
 *****************************************************************************/
-void nwkTxFrame(NwkFrame_t *frame)
+static void nwkTxSchedule(NwkFrame_t *frame)
 {
-  NwkFrameHeader_t *header = &frame->data.header;
+  frame->state = NWK_TX_STATE_SEND;
+  nwkFrameQueuePush(&nwkTxSendQueue[frame->tx.trafficClass], frame);
+
+#ifdef NWK_ENABLE_STATISTICS
+  NWK_TxClassStats_t *stats = &nwkTxStats[frame->tx.trafficClass];
+
+  frame->tx.queueTime = SYS_TimerGetTime();
+
+  if (++stats->depth > stats->maxDepth)
+    stats->maxDepth = stats->depth;
+#endif
+}
+
+/*****************************************************************************
+*****************************************************************************/
+static NwkFrame_t *nwkTxNextFrame(void)
+{
+  uint8_t next = NWK_TX_CLASSES_AMOUNT;
+  NwkFrame_t *frame;
 
-  if (frame->tx.control & NWK_TX_CONTROL_ROUTING)
+  // Strict priority, except that a class passed over NWK_TX_AGING_LIMIT
+  // times while it had frames to send is served next
+  for (uint8_t i = 0; i < NWK_TX_CLASSES_AMOUNT; i++)
   {
-    frame->state = NWK_TX_STATE_SEND;
+    if (NULL == nwkTxSendQueue[i].head)
+      continue;
+
+    if (NWK_TX_CLASSES_AMOUNT == next)
+      next = i;
+    else if (nwkTxSkipCount[i] >= NWK_TX_AGING_LIMIT)
+    {
+      next = i;
+      break;
+    }
   }
-  else
+
+  if (NWK_TX_CLASSES_AMOUNT == next)
+    return NULL;
+
+  for (uint8_t i = 0; i < NWK_TX_CLASSES_AMOUNT; i++)
   {
-#ifdef NWK_ENABLE_SECURITY
-    if (frame->data.header.nwkFcf.securityEnabled)
-      frame->state = NWK_TX_STATE_ENCRYPT;
-    else
+    if (i == next)
+      nwkTxSkipCount[i] = 0;
+    else if (nwkTxSendQueue[i].head && nwkTxSkipCount[i] < NWK_TX_AGING_LIMIT)
+      ++nwkTxSkipCount[i];
+  }
+
+  frame = nwkFrameQueuePop(&nwkTxSendQueue[next]);
+
+#ifdef NWK_ENABLE_STATISTICS
+  NWK_TxClassStats_t *stats = &nwkTxStats[next];
+  uint16_t wait = (uint16_t)SYS_TimerGetTime() - frame->tx.queueTime;
+
+  --stats->depth;
+  ++stats->sent;
+  stats->totalWait += wait;
+  if (wait > stats->maxWait)
+    stats->maxWait = wait;
 #endif
-      frame->state = NWK_TX_STATE_SEND;
+
+  return frame;
+}
+
+#if NWK_ACK_RTT_TABLE_SIZE > 0
+/*****************************************************************************
+*****************************************************************************/
+static NwkTxRttRecord_t *nwkTxRttFind(uint16_t dst)
+{
+  for (uint8_t i = 0; i < NWK_ACK_RTT_TABLE_SIZE; i++)
+    if (nwkTxRttTable[i].dst == dst)
+      return &nwkTxRttTable[i];
+  return NULL;
+}
+
+/*****************************************************************************
+*****************************************************************************/
+static void nwkTxRttUpdate(uint16_t dst, uint16_t rtt)
+{
+  NwkTxRttRecord_t *rec = nwkTxRttFind(dst);
+  int16_t delta;
+
+  if (rtt > NWK_ACK_WAIT_MAX_TIME)
+    rtt = NWK_ACK_WAIT_MAX_TIME;
+
+  if (NULL == rec)
+  {
+    rec = &nwkTxRttTable[nwkTxRttReplace];
+    if (++nwkTxRttReplace == NWK_ACK_RTT_TABLE_SIZE)
+      nwkTxRttReplace = 0;
+
+    rec->dst = dst;
+    rec->srtt = rtt << 3;
+    rec->rttvar = rtt << 1;
+    return;
   }
 
-  frame->tx.status = NWK_SUCCESS_STATUS;
+  // srtt += (rtt - srtt) / 8, rttvar += (|rtt - srtt| - rttvar) / 4
+  delta = (int16_t)rtt - (int16_t)(rec->srtt >> 3);
+  rec->srtt += delta;
+  if (delta < 0)
+    delta = -delta;
+  rec->rttvar += delta - (int16_t)(rec->rttvar >> 2);
+}
+
+/*****************************************************************************
+*****************************************************************************/
+static void nwkTxRttTimeout(uint16_t dst)
+{
+  NwkTxRttRecord_t *rec = nwkTxRttFind(dst);
+
+  // Back off the estimate so a path that got slower can be measured again
+  if (rec && rec->rttvar < (NWK_ACK_WAIT_MAX_TIME << 1))
+    rec->rttvar <<= 1;
+}
+#endif
+
+/*****************************************************************************
+*****************************************************************************/
+static uint16_t nwkTxAckWaitTime(uint16_t dst)
+{
+#if NWK_ACK_RTT_TABLE_SIZE > 0
+  NwkTxRttRecord_t *rec = nwkTxRttFind(dst);
+  uint32_t time;
+
+  if (NULL == rec)
+    return NWK_ACK_WAIT_TIME;
+
+  time = (rec->srtt >> 3) + (uint32_t)rec->rttvar;
+
+  if (time < NWK_ACK_WAIT_MIN_TIME)
+    return NWK_ACK_WAIT_MIN_TIME;
+  if (time > NWK_ACK_WAIT_MAX_TIME)
+    return NWK_ACK_WAIT_MAX_TIME;
+  return time;
+#else
+  (void)dst;
+  return NWK_ACK_WAIT_TIME;
+#endif
+}
+
+/*****************************************************************************
+*****************************************************************************/
+static void nwkTxStart(NwkFrame_t *frame)
+{
+  NwkFrameHeader_t *header = &frame->data.header;
 
   if (frame->tx.control & NWK_TX_CONTROL_BROADCAST_PAN_ID)
     frame->data.header.macDstPanId = 0xffff;
   else
     frame->data.header.macDstPanId = nwkIb.panId;
 
+#if NWK_SOURCE_ROUTE_TABLE_SIZE > 0
+  // A retry after the path has failed falls back to the route table
+  if (header->nwkFcf.sourceRoute && nwkIb.addr == header->nwkSrcAddr &&
+      0 == nwkSourceRouteSize(header->nwkDstAddr))
+    nwkSourceRouteStrip(frame);
+#endif
+
+#ifdef NWK_ENABLE_MULTICAST
+  if (header->nwkFcf.multicast)
+    header->macDstAddr = 0xffff;
+  else
+#endif
+#ifdef NWK_ENABLE_SOURCE_ROUTING
+  if (header->nwkFcf.sourceRoute)
+    header->macDstAddr = nwkSourceRouteNextHop(frame);
+  else
+#endif
 #ifdef NWK_ENABLE_ROUTING
   header->macDstAddr = nwkRouteNextHop(header->nwkDstAddr);
 #else
@@ -124,14 +314,194 @@ void nwkTxFrame(NwkFrame_t *frame)
   header->macSrcAddr = nwkIb.addr;
   header->macSeq = ++nwkIb.macSeqNum;
 
+#ifdef NWK_ENABLE_ROUTE_DISCOVERY
+  // Data for an unknown destination waits for a route instead of being
+  // broadcast. Service commands keep the broadcast fallback, link local
+  // and broadcast PAN ID frames are always sent as MAC broadcast.
+  if (0xffff == header->macDstAddr && 0xffff != header->nwkDstAddr &&
+      0 == header->nwkFcf.multicast && 0 != header->nwkDstEndpoint &&
+      0 == header->nwkFcf.linkLocal &&
+      !(frame->tx.control & NWK_TX_CONTROL_BROADCAST_PAN_ID) &&
+      nwkRouteDiscoveryRequest(frame))
+    return;
+#endif
+
   if (0xffff == header->macDstAddr)
     header->macFcf = 0x8841;
   else
     header->macFcf = 0x8861;
 
+#ifdef NWK_ENABLE_SECURITY
+  if (!(frame->tx.control & NWK_TX_CONTROL_ROUTING) && header->nwkFcf.securityEnabled)
+  {
+    nwkSecurityProcess(frame, true);
+    return;
+  }
+#endif
+
+  nwkTxSchedule(frame);
+}
+
+/*****************************************************************************
+*****************************************************************************/
+void nwkTxFrame(NwkFrame_t *frame)
+{
+  frame->tx.status = NWK_SUCCESS_STATUS;
   ++nwkTxActiveFrames;
+  nwkTxStart(frame);
+}
+
+/*****************************************************************************
+*****************************************************************************/
+static void nwkTxRetryStart(NwkFrame_t *frame)
+{
+  // A retry keeps the NWK sequence number, so the destination rejects it
+  // as a duplicate if the first copy arrived. The retry number lets routers
+  // relay it past their own duplicate rejection.
+  frame->data.header.nwkFcf.retry = (frame->tx.attempts < NWK_TX_MAX_RETRY_NUMBER) ?
+      frame->tx.attempts : NWK_TX_MAX_RETRY_NUMBER;
+  nwkTxStart(frame);
+}
+
+/*****************************************************************************
+*****************************************************************************/
+static void nwkTxRetry(NwkFrame_t *frame)
+{
+#ifdef NWK_ENABLE_SECURITY
+  // The retry number is covered by the MIC, so the payload is decrypted
+  // with the old header and encrypted again
+  if (frame->data.header.nwkFcf.securityEnabled)
+  {
+    nwkSecurityProcess(frame, false);
+    return;
+  }
+#endif
+
+  nwkTxRetryStart(frame);
+}
+
+/*****************************************************************************
+*****************************************************************************/
+static NwkFrame_t **nwkTxAckHashBucket(uint16_t dst, uint8_t seq)
+{
+  return &nwkTxAckHash[(uint8_t)(dst ^ (dst >> 8) ^ seq) & (NWK_TX_ACK_HASH_SIZE - 1)];
 }
 
+/*****************************************************************************
+*****************************************************************************/
+static void nwkTxAckWaitInsert(NwkFrame_t *frame)
+{
+  NwkFrame_t **bucket = nwkTxAckHashBucket(frame->data.header.nwkDstAddr,
+      frame->data.header.nwkSeq);
+  NwkFrame_t *prev = nwkTxAckWaitQueue.tail;
+
+  frame->tx.hashNext = *bucket;
+  *bucket = frame;
+
+  // New deadlines are usually the latest ones, so search from the tail
+  while (prev && (int16_t)(frame->tx.deadline - prev->tx.deadline) < 0)
+    prev = prev->tx.prev;
+
+  frame->tx.prev = prev;
+
+  if (prev)
+  {
+    frame->next = prev->next;
+    prev->next = frame;
+  }
+  else
+  {
+    frame->next = nwkTxAckWaitQueue.head;
+    nwkTxAckWaitQueue.head = frame;
+  }
+
+  if (frame->next)
+    frame->next->tx.prev = frame;
+  else
+    nwkTxAckWaitQueue.tail = frame;
+}
+
+/*****************************************************************************
+*****************************************************************************/
+static void nwkTxAckWaitRemove(NwkFrame_t *frame)
+{
+  NwkFrame_t **bucket = nwkTxAckHashBucket(frame->data.header.nwkDstAddr,
+      frame->data.header.nwkSeq);
+
+  if (*bucket == frame)
+  {
+    *bucket = frame->tx.hashNext;
+  }
+  else
+  {
+    NwkFrame_t *prev = *bucket;
+    while (prev->tx.hashNext != frame)
+      prev = prev->tx.hashNext;
+    prev->tx.hashNext = frame->tx.hashNext;
+  }
+
+  if (frame->tx.prev)
+    frame->tx.prev->next = frame->next;
+  else
+    nwkTxAckWaitQueue.head = frame->next;
+
+  if (frame->next)
+    frame->next->tx.prev = frame->tx.prev;
+  else
+    nwkTxAckWaitQueue.tail = frame->tx.prev;
+
+  frame->next = NULL;
+  frame->tx.prev = NULL;
+}
+
+/*****************************************************************************
+*****************************************************************************/
+static void nwkTxAckWaitTimerUpdate(void)
+{
+  int16_t interval;
+
+  SYS_TimerStop(&nwkTxAckWaitTimer);
+
+  if (NULL == nwkTxAckWaitQueue.head)
+    return;
+
+  interval = nwkTxAckWaitQueue.head->tx.deadline - (uint16_t)SYS_TimerGetTime();
+  nwkTxAckWaitTimer.interval = (interval > 0) ? interval : 1;
+  SYS_TimerStart(&nwkTxAckWaitTimer);
+}
+
+/*****************************************************************************
+*****************************************************************************/
+static void nwkTxBackoff(NwkFrame_t *frame)
+{
+  uint8_t exponent = ++frame->tx.attempts;
+
+  if (exponent > NWK_TX_MAX_BACKOFF_EXPONENT)
+    exponent = NWK_TX_MAX_BACKOFF_EXPONENT;
+
+  frame->state = NWK_TX_STATE_BACKOFF;
+  frame->tx.deadline = (uint16_t)SYS_TimerGetTime() +
+      NWK_TX_BACKOFF_INTERVAL * (1 + (rand() & ((1 << exponent) - 1)));
+  nwkTxAckWaitInsert(frame);
+}
+
+#ifdef NWK_ENABLE_ROUTE_DISCOVERY
+/*****************************************************************************
+*****************************************************************************/
+void nwkTxRouteDiscoveryConf(NwkFrame_t *frame, bool found)
+{
+  if (found)
+  {
+    nwkTxStart(frame);
+  }
+  else
+  {
+    frame->tx.status = NWK_NO_ROUTE_STATUS;
+    nwkTxConfirm(frame);
+  }
+}
+#endif
+
 /*****************************************************************************
 *****************************************************************************/
 void nwkTxBroadcastFrame(NwkFrame_t *frame)
@@ -142,10 +512,15 @@ void nwkTxBroadcastFrame(NwkFrame_t *frame)
     return;
 
   newFrame->tx.confirm = nwkTxBroadcastConf;
+  newFrame->tx.trafficClass = NWK_TX_CLASS_BROADCAST;
   memcpy((uint8_t *)&newFrame->data, (uint8_t *)&frame->data, frame->size);
 
-  newFrame->state = NWK_TX_STATE_SEND;
+  // The buffer may still hold the transmit state of its previous frame
   newFrame->tx.status = NWK_SUCCESS_STATUS;
+  newFrame->tx.deadline = 0;
+  newFrame->tx.control = 0;
+  newFrame->tx.retries = 0;
+  newFrame->tx.attempts = 0;
 
   newFrame->data.header.macFcf = 0x8841;
   newFrame->data.header.macDstAddr = 0xffff;
@@ -153,6 +528,8 @@ void nwkTxBroadcastFrame(NwkFrame_t *frame)
   newFrame->data.header.macSrcAddr = nwkIb.addr;
   newFrame->data.header.macSeq = ++nwkIb.macSeqNum;
 
+  nwkTxSchedule(newFrame);
+
   ++nwkTxActiveFrames;
 }
 
@@ -163,28 +540,95 @@ static void nwkTxBroadcastConf(NwkFrame_t *frame)
   nwkFrameFree(frame);
 }
 
+#ifdef NWK_ENABLE_ROUTING
+/*****************************************************************************
+*****************************************************************************/
+static void nwkTxLinkUpdate(NwkFrame_t *frame, bool success)
+{
+  // Frames that wait for an ACK are accounted on the ACK, so the next hop
+  // is credited with the whole delivery and each frame is counted once
+  if (0xffff != frame->data.header.macDstAddr)
+    nwkRouteLinkUpdate(frame->data.header.macDstAddr, success);
+}
+
+/*****************************************************************************
+*****************************************************************************/
+static bool nwkTxReroute(NwkFrame_t *frame)
+{
+  NwkFrameHeader_t *header = &frame->data.header;
+  uint16_t nextHop;
+
+  if (NWK_PHY_NO_ACK_STATUS != frame->tx.status ||
+      (frame->tx.control & NWK_TX_CONTROL_REROUTED) ||
+      header->nwkFcf.sourceRoute)
+    return false;
+
+  nextHop = nwkRouteNextHop(header->nwkDstAddr);
+  if (0xffff == nextHop || nextHop == header->macDstAddr)
+    return false;
+
+  // The route has failed over to another next hop. Give the frame one
+  // more chance there, only the MAC header changes.
+  frame->tx.control |= NWK_TX_CONTROL_REROUTED;
+  frame->tx.status = NWK_SUCCESS_STATUS;
+  header->macDstAddr = nextHop;
+  header->macSeq = ++nwkIb.macSeqNum;
+  nwkTxSchedule(frame);
+
+  return true;
+}
+#endif
+
+/*****************************************************************************
+*****************************************************************************/
+static void nwkTxConfirm(NwkFrame_t *frame)
+{
+  frame->state = NWK_TX_STATE_CONFIRM;
+  nwkFrameQueuePush(&nwkTxConfirmQueue, frame);
+}
+
 /*****************************************************************************
 *****************************************************************************/
 void nwkTxAckReceived(NWK_DataInd_t *ind)
 {
   NwkAckCommand_t *command = (NwkAckCommand_t *)ind->data;
+  NwkFrame_t **bucket = nwkTxAckHashBucket(ind->srcAddr, command->seq);
 
-  if (0 == nwkTxActiveFrames)
-    return;
-
-  for (int i = 0; i < NWK_BUFFERS_AMOUNT; i++)
+  for (NwkFrame_t *frame = *bucket; frame; frame = frame->tx.hashNext)
   {
-    NwkFrame_t *frame = nwkFrameByIndex(i);
-
-    if (NWK_TX_STATE_WAIT_ACK == frame->state && frame->data.header.nwkSeq == command->seq)
+    if (frame->data.header.nwkSeq == command->seq &&
+        frame->data.header.nwkDstAddr == ind->srcAddr)
     {
-      frame->state = NWK_TX_STATE_CONFIRM;
+      bool first = (frame == nwkTxAckWaitQueue.head);
+
+      nwkTxAckWaitRemove(frame);
+      if (first)
+        nwkTxAckWaitTimerUpdate();
+#if NWK_ACK_RTT_TABLE_SIZE > 0
+      // Only unambiguous samples, an ACK in backoff may belong to any attempt
+      if (NWK_TX_STATE_WAIT_ACK == frame->state && 0 == frame->tx.attempts)
+        nwkTxRttUpdate(frame->data.header.nwkDstAddr,
+            (uint16_t)SYS_TimerGetTime() - frame->tx.sentTime);
+#endif
+#ifdef NWK_ENABLE_ROUTING
+      nwkTxLinkUpdate(frame, true);
+#endif
       frame->tx.control = command->control;
+      nwkTxConfirm(frame);
       return;
     }
   }
 }
 
+#ifdef NWK_ENABLE_STATISTICS
+/*****************************************************************************
+*****************************************************************************/
+void NWK_GetTxClassStats(uint8_t txClass, NWK_TxClassStats_t *stats)
+{
+  *stats = nwkTxStats[txClass];
+}
+#endif
+
 /*****************************************************************************
 *****************************************************************************/
 bool nwkTxBusy(void)
@@ -196,21 +640,44 @@ bool nwkTxBusy(void)
 *****************************************************************************/
 static void nwkTxAckWaitTimerHandler(SYS_Timer_t *timer)
 {
-  if (0 == nwkTxActiveFrames)
-    return;
+  uint16_t time = SYS_TimerGetTime();
+  NwkFrame_t *frame;
 
-  for (int i = 0; i < NWK_BUFFERS_AMOUNT; i++)
+  while (NULL != (frame = nwkTxAckWaitQueue.head) &&
+         (int16_t)(time - frame->tx.deadline) >= 0)
   {
-    NwkFrame_t *frame = nwkFrameByIndex(i);
+    nwkTxAckWaitRemove(frame);
+
+    if (NWK_TX_STATE_BACKOFF == frame->state)
+    {
+      nwkTxRetry(frame);
+      continue;
+    }
+
+#if NWK_ACK_RTT_TABLE_SIZE > 0
+    nwkTxRttTimeout(frame->data.header.nwkDstAddr);
+#endif
+#ifdef NWK_ENABLE_ROUTING
+    nwkTxLinkUpdate(frame, false);
+#endif
+#if NWK_SOURCE_ROUTE_TABLE_SIZE > 0
+    if (frame->data.header.nwkFcf.sourceRoute)
+      nwkSourceRouteRemove(frame->data.header.nwkDstAddr);
+#endif
 
-    if (NWK_TX_STATE_WAIT_ACK == frame->state && 0 == --frame->tx.timeout)
+    if (frame->tx.attempts < frame->tx.retries)
+    {
+      nwkTxBackoff(frame);
+    }
+    else
     {
-      frame->state = NWK_TX_STATE_CONFIRM;
       frame->tx.status = NWK_NO_ACK_STATUS;
+      nwkTxConfirm(frame);
     }
   }
 
-  SYS_TimerStart(timer);
+  nwkTxAckWaitTimerUpdate();
+  (void)timer;
 }
 
 #ifdef NWK_ENABLE_SECURITY
@@ -218,7 +685,14 @@ static void nwkTxAckWaitTimerHandler(SYS_Timer_t *timer)
 *****************************************************************************/
 void nwkTxEncryptConf(NwkFrame_t *frame)
 {
-  frame->state = NWK_TX_STATE_SEND;
+  nwkTxSchedule(frame);
+}
+
+/*****************************************************************************
+*****************************************************************************/
+void nwkTxDecryptConf(NwkFrame_t *frame)
+{
+  nwkTxRetryStart(frame);
 }
 #endif
 
@@ -245,80 +719,59 @@ static uint8_t convertPhyStatus(uint8_t status)
 *****************************************************************************/
 void PHY_DataConf(uint8_t status)
 {
-  nwkTxPhyActiveFrame->tx.status = convertPhyStatus(status);
-  nwkTxPhyActiveFrame->state = NWK_TX_STATE_SENT;
+  NwkFrame_t *frame = nwkTxPhyActiveFrame;
+
   nwkTxPhyActiveFrame = NULL;
+  frame->tx.status = convertPhyStatus(status);
+
+  if (NWK_SUCCESS_STATUS == frame->tx.status &&
+      frame->data.header.nwkSrcAddr == nwkIb.addr &&
+      frame->data.header.nwkFcf.ackRequest)
+  {
+    frame->state = NWK_TX_STATE_WAIT_ACK;
+#if NWK_ACK_RTT_TABLE_SIZE > 0
+    frame->tx.sentTime = SYS_TimerGetTime();
+#endif
+    frame->tx.deadline = (uint16_t)SYS_TimerGetTime() +
+        nwkTxAckWaitTime(frame->data.header.nwkDstAddr);
+    nwkTxAckWaitInsert(frame);
+    nwkTxAckWaitTimerUpdate();
+  }
+  else
+  {
+#ifdef NWK_ENABLE_ROUTING
+    if (NWK_SUCCESS_STATUS == frame->tx.status || NWK_PHY_NO_ACK_STATUS == frame->tx.status)
+      nwkTxLinkUpdate(frame, NWK_SUCCESS_STATUS == frame->tx.status);
+#endif
+    nwkTxConfirm(frame);
+  }
 }
 
 /*****************************************************************************
 *****************************************************************************/
 void nwkTxTaskHandler(void)
 {
+  NwkFrame_t *frame;
+
   if (0 == nwkTxActiveFrames)
     return;
 
-  for (int i = 0; i < NWK_BUFFERS_AMOUNT; i++)
+  if (!PHY_Busy() && NULL != (frame = nwkTxNextFrame()))
   {
-    NwkFrame_t *frame = nwkFrameByIndex(i);
-
-    switch (frame->state)
-    {
-#ifdef NWK_ENABLE_SECURITY
-      case NWK_TX_STATE_ENCRYPT:
-      {
-        nwkSecurityProcess(frame, true);
-      } break;
-#endif
+    nwkTxPhyActiveFrame = frame;
+    frame->state = NWK_TX_STATE_WAIT_CONF;
+    PHY_DataReq((uint8_t *)&frame->data, frame->size);
+  }
 
-      case NWK_TX_STATE_SEND:
-      {
-        if (!PHY_Busy())
-        {
-          nwkTxPhyActiveFrame = frame;
-          frame->state = NWK_TX_STATE_WAIT_CONF;
-          PHY_DataReq((uint8_t *)&frame->data, frame->size);
-        }
-      } break;
-
-      case NWK_TX_STATE_WAIT_CONF:
-        break;
-
-      case NWK_TX_STATE_SENT:
-      {
-        if (NWK_SUCCESS_STATUS == frame->tx.status)
-        {
-          if (frame->data.header.nwkSrcAddr == nwkIb.addr &&
-              frame->data.header.nwkFcf.ackRequest)
-          {
-            frame->state = NWK_TX_STATE_WAIT_ACK;
-            frame->tx.timeout = NWK_ACK_WAIT_TIME / NWK_TX_ACK_WAIT_TIMER_INTERVAL + 1;
-            SYS_TimerStart(&nwkTxAckWaitTimer);
-          }
-          else
-          {
-            frame->state = NWK_TX_STATE_CONFIRM;
-          }
-        }
-        else
-        {
-          frame->state = NWK_TX_STATE_CONFIRM;
-	}
-      } break;
-
-      case NWK_TX_STATE_WAIT_ACK:
-        break;
-
-      case NWK_TX_STATE_CONFIRM:
-      {
+  while (NULL != (frame = nwkFrameQueuePop(&nwkTxConfirmQueue)))
+  {
 #ifdef NWK_ENABLE_ROUTING
-        nwkRouteFrameSent(frame);
-#endif
-        frame->tx.confirm(frame);
-        --nwkTxActiveFrames;
-      } break;
+    nwkRouteFrameSent(frame);
 
-      default:
-        break;
-    };
+    if (nwkTxReroute(frame))
+      continue;
+#endif
+    frame->tx.confirm(frame);
+    --nwkTxActiveFrames;
   }
 }
@@ -86,7 +86,6 @@ static PhyIb_t       phyIb;
 volatile PHY_State_t phyState = PHY_STATE_INITIAL;
 volatile uint8_t     phyTxStatus;
 volatile int8_t      phyRxRssi;
-static uint8_t       phyRxBuffer[128];
 
 /*****************************************************************************
 *****************************************************************************/
@@ -302,15 +301,25 @@ void PHY_TaskHandler(void)
       HAL_PhySpiSelect();
       HAL_PhySpiWriteByte(RF_CMD_FRAME_R);
       size = HAL_PhySpiWriteByte(0);
-      for (uint8_t i = 0; i < size + 1/*lqi*/; i++)
-        phyRxBuffer[i] = HAL_PhySpiWriteByte(0);
-      HAL_PhySpiDeselect();
 
-      ind.data = phyRxBuffer;
       ind.size = size - 2/*crc*/;
-      ind.lqi  = phyRxBuffer[size];
-      ind.rssi = phyRxRssi + PHY_RSSI_BASE_VAL;
-      PHY_DataInd(&ind);
+      ind.data = PHY_DataIndBuffer(ind.size);
+
+      if (ind.data)
+      {
+        for (uint8_t i = 0; i < ind.size; i++)
+          ind.data[i] = HAL_PhySpiWriteByte(0);
+        HAL_PhySpiWriteByte(0); // crc
+        HAL_PhySpiWriteByte(0);
+        ind.lqi = HAL_PhySpiWriteByte(0);
+      }
+      HAL_PhySpiDeselect();
+
+      if (ind.data)
+      {
+        ind.rssi = phyRxRssi + PHY_RSSI_BASE_VAL;
+        PHY_DataInd(&ind);
+      }
 
       while (TRX_CMD_PLL_ON != (phyReadRegister(TRX_STATUS_REG) & TRX_STATUS_TRX_STATUS_MASK));
       phySetRxState();
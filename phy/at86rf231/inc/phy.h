@@ -79,6 +79,7 @@ void PHY_Sleep(void);
 void PHY_Wakeup(void);
 void PHY_DataReq(uint8_t *data, uint8_t size);
 void PHY_DataConf(uint8_t status);
+uint8_t *PHY_DataIndBuffer(uint8_t size);
 void PHY_DataInd(PHY_DataInd_t *ind);
 void PHY_TaskHandler(void);
 
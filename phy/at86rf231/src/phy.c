@@ -61,10 +61,18 @@ enum
   PHY_REQ_ADDR    = (1 << 2),
   PHY_REQ_RX      = (1 << 3),
   PHY_REQ_RANDOM  = (1 << 4),
-  PHY_REQ_ENCRYPT = (1 << 5),
   PHY_REQ_ED      = (1 << 6),
 };
 
+#ifdef PHY_ENABLE_AES_MODULE
+typedef enum
+{
+  PHY_AES_STATE_IDLE,
+  PHY_AES_STATE_REQUEST,
+  PHY_AES_STATE_BUSY,
+} PhyAesState_t;
+#endif
+
 typedef struct PhyIb_t
 {
   uint8_t     request;
@@ -76,6 +84,8 @@ typedef struct PhyIb_t
 #ifdef PHY_ENABLE_AES_MODULE
   uint8_t     *text;
   uint8_t     *key;
+  uint8_t     aesKey[AES_BLOCK_SIZE];
+  bool        aesKeyValid;
 #endif
 } PhyIb_t;
 
@@ -92,7 +102,9 @@ static PhyIb_t       phyIb;
 volatile PHY_State_t phyState = PHY_STATE_INITIAL;
 volatile uint8_t     phyTxStatus;
 volatile int8_t      phyRxRssi;
-static uint8_t       phyRxBuffer[128];
+#ifdef PHY_ENABLE_AES_MODULE
+static PhyAesState_t phyAesState = PHY_AES_STATE_IDLE;
+#endif
 
 /*****************************************************************************
 *****************************************************************************/
@@ -111,6 +123,9 @@ void PHY_Init(void)
 
   phyIb.request = PHY_REQ_NONE;
   phyIb.rx = false;
+#ifdef PHY_ENABLE_AES_MODULE
+  phyIb.aesKeyValid = false;
+#endif
   phyState = PHY_STATE_IDLE;
 }
 
@@ -150,6 +165,11 @@ void PHY_SetShortAddr(uint16_t addr)
 *****************************************************************************/
 bool PHY_Busy(void)
 {
+#ifdef PHY_ENABLE_AES_MODULE
+  if (PHY_AES_STATE_IDLE != phyAesState)
+    return true;
+#endif
+
   return PHY_STATE_IDLE != phyState || PHY_REQ_NONE != phyIb.request;
 }
 
@@ -160,6 +180,11 @@ void PHY_Sleep(void)
   phyTrxSetState(TRX_CMD_TRX_OFF);
   HAL_PhySlpTrSet();
   phyState = PHY_STATE_SLEEP;
+
+#ifdef PHY_ENABLE_AES_MODULE
+  // The AES key is lost in SLEEP
+  phyIb.aesKeyValid = false;
+#endif
 }
 
 /*****************************************************************************
@@ -202,9 +227,9 @@ void PHY_RandomReq(void)
 *****************************************************************************/
 void PHY_EncryptReq(uint8_t *text, uint8_t *key)
 {
-  phyIb.request |= PHY_REQ_ENCRYPT;
   phyIb.text = text;
   phyIb.key = key;
+  phyAesState = PHY_AES_STATE_REQUEST;
 }
 #endif
 
@@ -271,16 +296,44 @@ static uint16_t phyGetRandomNumber(void)
 #ifdef PHY_ENABLE_AES_MODULE
 /*****************************************************************************
 *****************************************************************************/
-static void phyEncryptBlock(void)
+static bool phyAesKeyChanged(void)
 {
-  HAL_PhySpiSelect();
-  HAL_PhySpiWriteByte(RF_CMD_SRAM_W);
-  HAL_PhySpiWriteByte(AES_CTRL_REG);
-  HAL_PhySpiWriteByte((1 << AES_CTRL_MODE) | (0 << AES_CTRL_DIR));
+  bool changed = !phyIb.aesKeyValid;
+
   for (uint8_t i = 0; i < AES_BLOCK_SIZE; i++)
-    HAL_PhySpiWriteByte(phyIb.key[i]);
-  HAL_PhySpiDeselect();
+  {
+    if (phyIb.aesKey[i] != phyIb.key[i])
+    {
+      phyIb.aesKey[i] = phyIb.key[i];
+      changed = true;
+    }
+  }
 
+  phyIb.aesKeyValid = true;
+
+  return changed;
+}
+
+/*****************************************************************************
+*****************************************************************************/
+static void phyEncryptBlock(void)
+{
+  // Transactions are atomic, the IRQ handler accesses the SPI as well
+  ATOMIC_SECTION_ENTER
+
+  // ECB encryption leaves the key in place, so it is only written when changed
+  if (phyAesKeyChanged())
+  {
+    HAL_PhySpiSelect();
+    HAL_PhySpiWriteByte(RF_CMD_SRAM_W);
+    HAL_PhySpiWriteByte(AES_CTRL_REG);
+    HAL_PhySpiWriteByte((1 << AES_CTRL_MODE) | (0 << AES_CTRL_DIR));
+    for (uint8_t i = 0; i < AES_BLOCK_SIZE; i++)
+      HAL_PhySpiWriteByte(phyIb.aesKey[i]);
+    HAL_PhySpiDeselect();
+  }
+
+  // Writing past the state into AES_CTRL_MIRROR starts the operation
   HAL_PhySpiSelect();
   HAL_PhySpiWriteByte(RF_CMD_SRAM_W);
   HAL_PhySpiWriteByte(AES_CTRL_REG);
@@ -290,14 +343,53 @@ static void phyEncryptBlock(void)
   HAL_PhySpiWriteByte((1 << AES_CTRL_REQUEST) | (0 << AES_CTRL_MODE) | (0 << AES_CTRL_DIR));
   HAL_PhySpiDeselect();
 
-  HAL_Delay(AES_CORE_CYCLE_TIME);
+  ATOMIC_SECTION_LEAVE
 
+  phyAesState = PHY_AES_STATE_BUSY;
+}
+
+/*****************************************************************************
+*****************************************************************************/
+static bool phyEncryptBlockDone(void)
+{
+  bool done;
+
+  ATOMIC_SECTION_ENTER
+
+  // AES_STATUS, AES_CTRL and AES_STATE are adjacent, so the result is read
+  // in the same transaction as soon as the status shows completion
   HAL_PhySpiSelect();
   HAL_PhySpiWriteByte(RF_CMD_SRAM_R);
-  HAL_PhySpiWriteByte(AES_STATE_REG);
-  for (uint8_t i = 0; i < AES_BLOCK_SIZE; i++)
-    phyIb.text[i] = HAL_PhySpiWriteByte(0);
+  HAL_PhySpiWriteByte(AES_STATUS_REG);
+  done = HAL_PhySpiWriteByte(0) & (1 << AES_STATUS_DONE);
+  if (done)
+  {
+    HAL_PhySpiWriteByte(0);
+    for (uint8_t i = 0; i < AES_BLOCK_SIZE; i++)
+      phyIb.text[i] = HAL_PhySpiWriteByte(0);
+  }
   HAL_PhySpiDeselect();
+
+  ATOMIC_SECTION_LEAVE
+
+  return done;
+}
+
+/*****************************************************************************
+*****************************************************************************/
+static void phyAesTaskHandler(void)
+{
+  // The core takes AES_CORE_CYCLE_TIME, the status is polled once per task
+  // handler call instead of busy waiting for it
+  if (PHY_AES_STATE_BUSY == phyAesState && phyEncryptBlockDone())
+  {
+    phyAesState = PHY_AES_STATE_IDLE;
+    PHY_EncryptConf();
+  }
+
+  // The confirmation handler may have requested the next block already
+  if (PHY_AES_STATE_REQUEST == phyAesState)
+    phyEncryptBlock();
 }
 #endif
 
@@ -336,14 +428,6 @@ static void phyHandleSetRequests(void)
   }
 #endif
 
-#ifdef PHY_ENABLE_AES_MODULE
-  if (phyIb.request & PHY_REQ_ENCRYPT)
-  {
-    phyEncryptBlock();
-    PHY_EncryptConf();
-  }
-#endif
-
 #ifdef PHY_ENABLE_ENERGY_DETECTION
   if (phyIb.request & PHY_REQ_ED)
   {
@@ -377,6 +461,13 @@ static void phyTrxSetState(uint8_t state)
 *****************************************************************************/
 void PHY_TaskHandler(void)
 {
+#ifdef PHY_ENABLE_AES_MODULE
+  // The AES module is accessed through the frame buffer SRAM interface, so it
+  // is only accessed while no frame is being transmitted or received
+  if (PHY_STATE_IDLE == phyState)
+    phyAesTaskHandler();
+#endif
+
   switch (phyState)
   {
     case PHY_STATE_IDLE:
@@ -402,15 +493,25 @@ void PHY_TaskHandler(void)
       HAL_PhySpiSelect();
       HAL_PhySpiWriteByte(RF_CMD_FRAME_R);
       size = HAL_PhySpiWriteByte(0);
-      for (uint8_t i = 0; i < size + 1/*lqi*/; i++)
-        phyRxBuffer[i] = HAL_PhySpiWriteByte(0);
-      HAL_PhySpiDeselect();
 
-      ind.data = phyRxBuffer;
       ind.size = size - 2/*crc*/;
-      ind.lqi  = phyRxBuffer[size];
-      ind.rssi = phyRxRssi + PHY_RSSI_BASE_VAL;
-      PHY_DataInd(&ind);
+      ind.data = PHY_DataIndBuffer(ind.size);
+
+      if (ind.data)
+      {
+        for (uint8_t i = 0; i < ind.size; i++)
+          ind.data[i] = HAL_PhySpiWriteByte(0);
+        HAL_PhySpiWriteByte(0); // crc
+        HAL_PhySpiWriteByte(0);
+        ind.lqi = HAL_PhySpiWriteByte(0);
+      }
+      HAL_PhySpiDeselect();
+
+      if (ind.data)
+      {
+        ind.rssi = phyRxRssi + PHY_RSSI_BASE_VAL;
+        PHY_DataInd(&ind);
+      }
 
       while (TRX_CMD_PLL_ON != (phyReadRegister(TRX_STATUS_REG) & TRX_STATUS_TRX_STATUS_MASK));
       phyState = PHY_STATE_IDLE;
@@ -75,10 +75,19 @@ enum
   PHY_REQ_ADDR    = (1 << 2),
   PHY_REQ_RX      = (1 << 3),
   PHY_REQ_RANDOM  = (1 << 4),
-  PHY_REQ_ENCRYPT = (1 << 5),
   PHY_REQ_ED      = (1 << 6),
 };
 
+#ifdef PHY_ENABLE_AES_MODULE
+typedef enum
+{
+  PHY_AES_STATE_IDLE,
+  PHY_AES_STATE_REQUEST,
+  PHY_AES_STATE_BUSY,
+  PHY_AES_STATE_DONE,
+} PhyAesState_t;
+#endif
+
 typedef struct PhyIb_t
 {
   uint8_t     request;
@@ -90,6 +99,8 @@ typedef struct PhyIb_t
 #ifdef PHY_ENABLE_AES_MODULE
   uint8_t     *text;
   uint8_t     *key;
+  uint8_t     aesKey[AES_BLOCK_SIZE];
+  bool        aesKeyValid;
 #endif
 } PhyIb_t;
 
@@ -108,7 +119,9 @@ static volatile PhyState_t  phyState = PHY_STATE_INITIAL;
 static volatile uint8_t     phyTxStatus;
 static volatile int8_t      phyRxRssi;
 static volatile uint8_t     phyRxSize;
-static uint8_t              phyRxBuffer[128];
+#ifdef PHY_ENABLE_AES_MODULE
+static volatile PhyAesState_t phyAesState = PHY_AES_STATE_IDLE;
+#endif
 
 /*****************************************************************************
 *****************************************************************************/
@@ -135,6 +148,9 @@ void PHY_Init(void)
 
   phyIb.request = PHY_REQ_NONE;
   phyIb.rx = false;
+#ifdef PHY_ENABLE_AES_MODULE
+  phyIb.aesKeyValid = false;
+#endif
   phyState = PHY_STATE_IDLE;
 }
 
@@ -174,6 +190,11 @@ void PHY_SetShortAddr(uint16_t addr)
 *****************************************************************************/
 bool PHY_Busy(void)
 {
+#ifdef PHY_ENABLE_AES_MODULE
+  if (PHY_AES_STATE_IDLE != phyAesState)
+    return true;
+#endif
+
   return PHY_STATE_IDLE != phyState || PHY_REQ_NONE != phyIb.request;
 }
 
@@ -184,6 +205,11 @@ void PHY_Sleep(void)
   phyTrxSetState(TRX_CMD_TRX_OFF);
   TRXPR_REG_s.slptr = 1;
   phyState = PHY_STATE_SLEEP;
+
+#ifdef PHY_ENABLE_AES_MODULE
+  // The AES key is lost in SLEEP
+  phyIb.aesKeyValid = false;
+#endif
 }
 
 /*****************************************************************************
@@ -224,9 +250,9 @@ void PHY_RandomReq(void)
 *****************************************************************************/
 void PHY_EncryptReq(uint8_t *text, uint8_t *key)
 {
-  phyIb.request |= PHY_REQ_ENCRYPT;
   phyIb.text = text;
   phyIb.key = key;
+  phyAesState = PHY_AES_STATE_REQUEST;
 }
 #endif
 
@@ -278,6 +304,17 @@ ISR(TRX24_RX_END_vect)
   phyState = PHY_STATE_RX_IND;
 }
 
+#ifdef PHY_ENABLE_AES_MODULE
+/*****************************************************************************
+*****************************************************************************/
+ISR(TRX24_AES_READY_vect)
+{
+  // Reading the status clears AES_RY and AES_ER
+  (void)AES_STATUS;
+  phyAesState = PHY_AES_STATE_DONE;
+}
+#endif
+
 #ifdef PHY_ENABLE_RANDOM_NUMBER_GENERATOR
 /*****************************************************************************
 *****************************************************************************/
@@ -307,22 +344,60 @@ static uint16_t phyGetRandomNumber(void)
 #ifdef PHY_ENABLE_AES_MODULE
 /*****************************************************************************
 *****************************************************************************/
-static void phyEncryptBlock(void)
+static bool phyAesKeyChanged(void)
 {
+  bool changed = !phyIb.aesKeyValid;
+
   for (uint8_t i = 0; i < AES_BLOCK_SIZE; i++)
-    AES_KEY = phyIb.key[i];
+  {
+    if (phyIb.aesKey[i] != phyIb.key[i])
+    {
+      phyIb.aesKey[i] = phyIb.key[i];
+      changed = true;
+    }
+  }
 
-  AES_CTRL = (0 << AES_CTRL_DIR) | (0 << AES_CTRL_MODE);
+  phyIb.aesKeyValid = true;
+
+  return changed;
+}
+
+/*****************************************************************************
+*****************************************************************************/
+static void phyEncryptBlock(void)
+{
+  // ECB encryption leaves the key in place, so it is only written when changed
+  if (phyAesKeyChanged())
+  {
+    for (uint8_t i = 0; i < AES_BLOCK_SIZE; i++)
+      AES_KEY = phyIb.aesKey[i];
+  }
+
+  AES_CTRL = (1 << AES_CTRL_IM) | (0 << AES_CTRL_DIR) | (0 << AES_CTRL_MODE);
 
   for (uint8_t i = 0; i < AES_BLOCK_SIZE; i++)
     AES_STATE = phyIb.text[i];
 
+  phyAesState = PHY_AES_STATE_BUSY;
   AES_CTRL |= (1 << AES_CTRL_REQUEST);
+}
 
-  while (0 == (AES_STATUS & (1 << AES_STATUS_RY)));
+/*****************************************************************************
+*****************************************************************************/
+static void phyAesTaskHandler(void)
+{
+  if (PHY_AES_STATE_DONE == phyAesState)
+  {
+    for (uint8_t i = 0; i < AES_BLOCK_SIZE; i++)
+      phyIb.text[i] = AES_STATE;
 
-  for (uint8_t i = 0; i < AES_BLOCK_SIZE; i++)
-    phyIb.text[i] = AES_STATE;
+    phyAesState = PHY_AES_STATE_IDLE;
+    PHY_EncryptConf();
+  }
+
+  // The confirmation handler may have requested the next block already
+  if (PHY_AES_STATE_REQUEST == phyAesState)
+    phyEncryptBlock();
 }
 #endif
 
@@ -369,14 +444,6 @@ static void phyHandleSetRequests(void)
   }
 #endif
 
-#ifdef PHY_ENABLE_AES_MODULE
-  if (phyIb.request & PHY_REQ_ENCRYPT)
-  {
-    phyEncryptBlock();
-    PHY_EncryptConf();
-  }
-#endif
-
 #ifdef PHY_ENABLE_ENERGY_DETECTION
   if (phyIb.request & PHY_REQ_ED)
   {
@@ -413,6 +480,11 @@ static inline void phyTrxSetState(uint8_t state)
 *****************************************************************************/
 void PHY_TaskHandler(void)
 {
+#ifdef PHY_ENABLE_AES_MODULE
+  if (PHY_STATE_SLEEP != phyState)
+    phyAesTaskHandler();
+#endif
+
   switch (phyState)
   {
     case PHY_STATE_IDLE:
@@ -434,14 +506,18 @@ void PHY_TaskHandler(void)
     {
       PHY_DataInd_t ind;
 
-      for (uint8_t i = 0; i < phyRxSize + 1/*lqi*/; i++)
-        phyRxBuffer[i] = TRX_FRAME_BUFFER(i);
-
-      ind.data = phyRxBuffer;
       ind.size = phyRxSize - 2/*crc*/;
-      ind.lqi  = phyRxBuffer[phyRxSize];
-      ind.rssi = phyRxRssi + PHY_RSSI_BASE_VAL;
-      PHY_DataInd(&ind);
+      ind.data = PHY_DataIndBuffer(ind.size);
+
+      if (ind.data)
+      {
+        for (uint8_t i = 0; i < ind.size; i++)
+          ind.data[i] = TRX_FRAME_BUFFER(i);
+
+        ind.lqi  = TRX_FRAME_BUFFER(phyRxSize);
+        ind.rssi = phyRxRssi + PHY_RSSI_BASE_VAL;
+        PHY_DataInd(&ind);
+      }
 
       while (TRX_CMD_PLL_ON != TRX_STATUS_REG_s.trxStatus);
       phyState = PHY_STATE_IDLE;
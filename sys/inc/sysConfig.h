@@ -52,6 +52,14 @@
 #define NWK_BUFFERS_AMOUNT                       1
 #endif
 
+#ifndef NWK_SMALL_BUFFERS_AMOUNT
+#define NWK_SMALL_BUFFERS_AMOUNT                 0
+#endif
+
+#ifndef NWK_SMALL_BUFFER_PAYLOAD_SIZE
+#define NWK_SMALL_BUFFER_PAYLOAD_SIZE            8
+#endif
+
 #ifndef NWK_MAX_ENDPOINTS_AMOUNT
 #define NWK_MAX_ENDPOINTS_AMOUNT                 1
 #endif
@@ -72,17 +80,140 @@
 #define NWK_ROUTE_DEFAULT_SCORE                  3
 #endif
 
+#ifndef NWK_ROUTE_NEIGHBOUR_TABLE_SIZE
+#define NWK_ROUTE_NEIGHBOUR_TABLE_SIZE           8
+#endif
+
 #ifndef NWK_ACK_WAIT_TIME
 #define NWK_ACK_WAIT_TIME                        1000 // ms
 #endif
 
+#ifndef NWK_ACK_WAIT_MIN_TIME
+#define NWK_ACK_WAIT_MIN_TIME                    50 // ms
+#endif
+
+#ifndef NWK_ACK_WAIT_MAX_TIME
+#define NWK_ACK_WAIT_MAX_TIME                    5000 // ms
+#endif
+
+#ifndef NWK_ACK_RTT_TABLE_SIZE
+#define NWK_ACK_RTT_TABLE_SIZE                   0
+#endif
+
+#ifndef NWK_ACK_RETRIES
+#define NWK_ACK_RETRIES                          0
+#endif
+
+#ifndef NWK_TX_AGING_LIMIT
+#define NWK_TX_AGING_LIMIT                       8
+#endif
+
+#ifndef NWK_GROUPS_AMOUNT
+#define NWK_GROUPS_AMOUNT                        10
+#endif
+
+//#define NWK_ENABLE_STATISTICS
+
 //#define NWK_ENABLE_ROUTING
+//#define NWK_ENABLE_ROUTE_DISCOVERY
+//#define NWK_ENABLE_MULTICAST
 //#define NWK_ENABLE_SECURITY
 
+#ifndef NWK_ROUTE_DISCOVERY_TABLE_SIZE
+#define NWK_ROUTE_DISCOVERY_TABLE_SIZE           3
+#endif
+
+#ifndef NWK_ROUTE_DISCOVERY_TIMEOUT
+#define NWK_ROUTE_DISCOVERY_TIMEOUT              1000 // ms
+#endif
+
+#if defined(NWK_ENABLE_ROUTE_DISCOVERY) && !defined(NWK_ENABLE_ROUTING)
+  #error NWK_ENABLE_ROUTE_DISCOVERY requires NWK_ENABLE_ROUTING
+#endif
+
+//#define NWK_ENABLE_ROUTE_STORE
+
+#ifndef NWK_ROUTE_STORE_ADDR
+#define NWK_ROUTE_STORE_ADDR                     0
+#endif
+
+#ifndef NWK_ROUTE_STORE_INTERVAL
+#define NWK_ROUTE_STORE_INTERVAL                 300000 // ms
+#endif
+
+#if defined(NWK_ENABLE_ROUTE_STORE) && !defined(NWK_ENABLE_ROUTING)
+  #error NWK_ENABLE_ROUTE_STORE requires NWK_ENABLE_ROUTING
+#endif
+
+//#define NWK_ENABLE_SOURCE_ROUTING
+
+#ifndef NWK_SOURCE_ROUTE_TABLE_SIZE
+#define NWK_SOURCE_ROUTE_TABLE_SIZE              0
+#endif
+
+#ifndef NWK_SOURCE_ROUTE_MAX_HOPS
+#define NWK_SOURCE_ROUTE_MAX_HOPS                8
+#endif
+
+#ifndef NWK_SOURCE_ROUTE_COORDINATOR_ADDR
+#define NWK_SOURCE_ROUTE_COORDINATOR_ADDR        0x0000
+#endif
+
+#ifndef NWK_SOURCE_ROUTE_RECORD_INTERVAL
+#define NWK_SOURCE_ROUTE_RECORD_INTERVAL         60000 // ms
+#endif
+
+#if defined(NWK_ENABLE_SOURCE_ROUTING) && !defined(NWK_ENABLE_ROUTING)
+  #error NWK_ENABLE_SOURCE_ROUTING requires NWK_ENABLE_ROUTING
+#endif
+
+#if (NWK_SOURCE_ROUTE_TABLE_SIZE > 0) && !defined(NWK_ENABLE_SOURCE_ROUTING)
+  #error NWK_SOURCE_ROUTE_TABLE_SIZE requires NWK_ENABLE_SOURCE_ROUTING
+#endif
+
+//#define NWK_ENABLE_COLLECTION
+
+#ifndef NWK_COLLECTION_SINK_ADDR
+#define NWK_COLLECTION_SINK_ADDR                 0x0000
+#endif
+
+#ifndef NWK_COLLECTION_BEACON_INTERVAL
+#define NWK_COLLECTION_BEACON_INTERVAL           10000 // ms
+#endif
+
+#if defined(NWK_ENABLE_COLLECTION) && !defined(NWK_ENABLE_ROUTING)
+  #error NWK_ENABLE_COLLECTION requires NWK_ENABLE_ROUTING
+#endif
+
+#ifndef NWK_LINK_KEY_TABLE_SIZE
+#define NWK_LINK_KEY_TABLE_SIZE                  0
+#endif
+
+#ifndef NWK_LINK_KEY_CACHE_SIZE
+#define NWK_LINK_KEY_CACHE_SIZE                  4
+#endif
+
+#if (NWK_LINK_KEY_TABLE_SIZE > 0) && !defined(NWK_ENABLE_SECURITY)
+  #error NWK_LINK_KEY_TABLE_SIZE requires NWK_ENABLE_SECURITY
+#endif
+
+#if (NWK_LINK_KEY_TABLE_SIZE > 254) || (NWK_LINK_KEY_CACHE_SIZE < 2) || (NWK_LINK_KEY_CACHE_SIZE % 2)
+  #error Invalid NWK_LINK_KEY_TABLE_SIZE or NWK_LINK_KEY_CACHE_SIZE
+#endif
+
+// 0 - PHY AES module, 1 - software XTEA, 2 - software AES-128
 #ifndef SYS_SECURITY_MODE
 #define SYS_SECURITY_MODE                        0
 #endif
 
+#if SYS_SECURITY_MODE > 2
+  #error Unknown SYS_SECURITY_MODE
+#endif
+
+#if defined(NWK_ENABLE_SECURITY) && (SYS_SECURITY_MODE == 0) && defined(PHY_AT86RF230)
+  #error AT86RF230 has no AES module, use SYS_SECURITY_MODE 2 instead
+#endif
+
 /*****************************************************************************
 *****************************************************************************/
 #if defined(NWK_ENABLE_SECURITY) && (SYS_SECURITY_MODE == 0)
@@ -73,6 +73,7 @@ void SYS_TimerInit(void);
 void SYS_TimerStart(SYS_Timer_t *timer);
 void SYS_TimerStop(SYS_Timer_t *timer);
 bool SYS_TimerStarted(SYS_Timer_t *timer);
+uint32_t SYS_TimerGetTime(void);
 void SYS_TimerTaskHandler(void);
 
 #endif // _SYS_TIMER_H_
@@ -58,6 +58,9 @@
 
   #define INLINE PRAGMA(inline=forced) static
 
+  #define PROGMEM_DECLARE(x) __flash x
+  #define PGM_READ_BYTE(x) (*(x))
+
   #define SYS_EnableInterrupts() __enable_interrupt()
 
   #define wdt_reset() (__watchdog_reset())
@@ -99,6 +102,9 @@
 
   #define INLINE static inline __attribute__ ((always_inline))
 
+  #define PROGMEM_DECLARE(x) x PROGMEM
+  #define PGM_READ_BYTE(x) pgm_read_byte(x)
+
   #define SYS_EnableInterrupts() sei()
 
   #define ATOMIC_SECTION_ENTER   { uint8_t __atomic = SREG; cli();
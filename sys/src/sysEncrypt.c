@@ -43,6 +43,7 @@
 
 #include <stdint.h>
 #include <string.h>
+#include "sysTypes.h"
 #include "sysEncrypt.h"
 #include "sysConfig.h"
 #include "phy.h"
@@ -53,6 +54,8 @@
 *****************************************************************************/
 #if SYS_SECURITY_MODE == 1
 static void swEncryptReq(uint32_t *text, uint32_t *key);
+#elif SYS_SECURITY_MODE == 2
+static void aesEncryptReq(uint8_t *text, uint8_t *key);
 #endif
 
 /*****************************************************************************
@@ -63,6 +66,8 @@ void SYS_EncryptReq(uint8_t *text, uint8_t *key)
   PHY_EncryptReq(text, key);
 #elif SYS_SECURITY_MODE == 1
   swEncryptReq((uint32_t *)text, (uint32_t *)key);
+#elif SYS_SECURITY_MODE == 2
+  aesEncryptReq(text, key);
 #endif
 }
 
@@ -108,4 +113,144 @@ static void swEncryptReq(uint32_t *text, uint32_t *key)
 }
 #endif
 
+#if SYS_SECURITY_MODE == 2
+#if defined(__AES__)
+#include <wmmintrin.h>
+
+/*****************************************************************************
+*****************************************************************************/
+static inline __m128i aesExpandKey(__m128i key, __m128i assist)
+{
+  assist = _mm_shuffle_epi32(assist, 0xff);
+  key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+  key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+  key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+  return _mm_xor_si128(key, assist);
+}
+
+#define AES_ROUND(rcon) \
+  key = aesExpandKey(key, _mm_aeskeygenassist_si128(key, rcon)); \
+  state = _mm_aesenc_si128(state, key)
+
+/*****************************************************************************
+*****************************************************************************/
+static void aes(uint8_t *text, uint8_t const *key_)
+{
+  __m128i key = _mm_loadu_si128((__m128i const *)key_);
+  __m128i state = _mm_xor_si128(_mm_loadu_si128((__m128i const *)text), key);
+
+  AES_ROUND(0x01);
+  AES_ROUND(0x02);
+  AES_ROUND(0x04);
+  AES_ROUND(0x08);
+  AES_ROUND(0x10);
+  AES_ROUND(0x20);
+  AES_ROUND(0x40);
+  AES_ROUND(0x80);
+  AES_ROUND(0x1b);
+  key = aesExpandKey(key, _mm_aeskeygenassist_si128(key, 0x36));
+  state = _mm_aesenclast_si128(state, key);
+
+  _mm_storeu_si128((__m128i *)text, state);
+}
+
+#else
+
+/*****************************************************************************
+*****************************************************************************/
+static PROGMEM_DECLARE(const uint8_t aesSbox[256]) =
+{
+  0x63, 0x7c, 0x77, 0x7b, 0xf2, 0x6b, 0x6f, 0xc5, 0x30, 0x01, 0x67, 0x2b, 0xfe, 0xd7, 0xab, 0x76,
+  0xca, 0x82, 0xc9, 0x7d, 0xfa, 0x59, 0x47, 0xf0, 0xad, 0xd4, 0xa2, 0xaf, 0x9c, 0xa4, 0x72, 0xc0,
+  0xb7, 0xfd, 0x93, 0x26, 0x36, 0x3f, 0xf7, 0xcc, 0x34, 0xa5, 0xe5, 0xf1, 0x71, 0xd8, 0x31, 0x15,
+  0x04, 0xc7, 0x23, 0xc3, 0x18, 0x96, 0x05, 0x9a, 0x07, 0x12, 0x80, 0xe2, 0xeb, 0x27, 0xb2, 0x75,
+  0x09, 0x83, 0x2c, 0x1a, 0x1b, 0x6e, 0x5a, 0xa0, 0x52, 0x3b, 0xd6, 0xb3, 0x29, 0xe3, 0x2f, 0x84,
+  0x53, 0xd1, 0x00, 0xed, 0x20, 0xfc, 0xb1, 0x5b, 0x6a, 0xcb, 0xbe, 0x39, 0x4a, 0x4c, 0x58, 0xcf,
+  0xd0, 0xef, 0xaa, 0xfb, 0x43, 0x4d, 0x33, 0x85, 0x45, 0xf9, 0x02, 0x7f, 0x50, 0x3c, 0x9f, 0xa8,
+  0x51, 0xa3, 0x40, 0x8f, 0x92, 0x9d, 0x38, 0xf5, 0xbc, 0xb6, 0xda, 0x21, 0x10, 0xff, 0xf3, 0xd2,
+  0xcd, 0x0c, 0x13, 0xec, 0x5f, 0x97, 0x44, 0x17, 0xc4, 0xa7, 0x7e, 0x3d, 0x64, 0x5d, 0x19, 0x73,
+  0x60, 0x81, 0x4f, 0xdc, 0x22, 0x2a, 0x90, 0x88, 0x46, 0xee, 0xb8, 0x14, 0xde, 0x5e, 0x0b, 0xdb,
+  0xe0, 0x32, 0x3a, 0x0a, 0x49, 0x06, 0x24, 0x5c, 0xc2, 0xd3, 0xac, 0x62, 0x91, 0x95, 0xe4, 0x79,
+  0xe7, 0xc8, 0x37, 0x6d, 0x8d, 0xd5, 0x4e, 0xa9, 0x6c, 0x56, 0xf4, 0xea, 0x65, 0x7a, 0xae, 0x08,
+  0xba, 0x78, 0x25, 0x2e, 0x1c, 0xa6, 0xb4, 0xc6, 0xe8, 0xdd, 0x74, 0x1f, 0x4b, 0xbd, 0x8b, 0x8a,
+  0x70, 0x3e, 0xb5, 0x66, 0x48, 0x03, 0xf6, 0x0e, 0x61, 0x35, 0x57, 0xb9, 0x86, 0xc1, 0x1d, 0x9e,
+  0xe1, 0xf8, 0x98, 0x11, 0x69, 0xd9, 0x8e, 0x94, 0x9b, 0x1e, 0x87, 0xe9, 0xce, 0x55, 0x28, 0xdf,
+  0x8c, 0xa1, 0x89, 0x0d, 0xbf, 0xe6, 0x42, 0x68, 0x41, 0x99, 0x2d, 0x0f, 0xb0, 0x54, 0xbb, 0x16,
+};
+
+/*****************************************************************************
+*****************************************************************************/
+static inline uint8_t aesSub(uint8_t x)
+{
+  return PGM_READ_BYTE(&aesSbox[x]);
+}
+
+/*****************************************************************************
+*****************************************************************************/
+static inline uint8_t aesXtime(uint8_t x)
+{
+  // Reduction is masked instead of branched on, so timing does not depend on data
+  return (x << 1) ^ (0x1b & -(x >> 7));
+}
+
+/*****************************************************************************
+*****************************************************************************/
+static void aes(uint8_t *text, uint8_t const *key)
+{
+  uint8_t rk[16], t[16];
+  uint8_t rcon = 0x01;
+
+  // Round keys are expanded on the fly, there is no RAM for a full schedule
+  for (uint8_t i = 0; i < 16; i++)
+  {
+    rk[i] = key[i];
+    text[i] ^= rk[i];
+  }
+
+  for (uint8_t round = 1; round <= 10; round++)
+  {
+    // SubBytes and ShiftRows, the state is stored column by column
+    for (uint8_t i = 0; i < 16; i++)
+      t[i] = aesSub(text[(i + ((i & 3) << 2)) & 15]);
+
+    if (round < 10)
+    {
+      for (uint8_t i = 0; i < 16; i += 4)
+      {
+        uint8_t e = t[i] ^ t[i+1] ^ t[i+2] ^ t[i+3];
+
+        text[i+0] = t[i+0] ^ e ^ aesXtime(t[i+0] ^ t[i+1]);
+        text[i+1] = t[i+1] ^ e ^ aesXtime(t[i+1] ^ t[i+2]);
+        text[i+2] = t[i+2] ^ e ^ aesXtime(t[i+2] ^ t[i+3]);
+        text[i+3] = t[i+3] ^ e ^ aesXtime(t[i+3] ^ t[i+0]);
+      }
+    }
+    else
+    {
+      memcpy(text, t, 16);
+    }
+
+    rk[0] ^= aesSub(rk[13]) ^ rcon;
+    rk[1] ^= aesSub(rk[14]);
+    rk[2] ^= aesSub(rk[15]);
+    rk[3] ^= aesSub(rk[12]);
+    for (uint8_t i = 4; i < 16; i++)
+      rk[i] ^= rk[i-4];
+    rcon = aesXtime(rcon);
+
+    for (uint8_t i = 0; i < 16; i++)
+      text[i] ^= rk[i];
+  }
+}
+#endif // __AES__
+
+/*****************************************************************************
+*****************************************************************************/
+static void aesEncryptReq(uint8_t *text, uint8_t *key)
+{
+  aes(text, key);
+  SYS_EncryptConf();
+}
+#endif
+
 #endif // NWK_ENABLE_SECURITY
@@ -53,12 +53,14 @@ static void placeTimer(SYS_Timer_t *timer);
 /*****************************************************************************
 *****************************************************************************/
 static SYS_Timer_t *timers;
+static uint32_t sysTimerTime;
 
 /*****************************************************************************
 *****************************************************************************/
 void SYS_TimerInit(void)
 {
   timers = NULL;
+  sysTimerTime = 0;
 }
 
 /*****************************************************************************
@@ -103,6 +105,13 @@ bool SYS_TimerStarted(SYS_Timer_t *timer)
   return false;
 }
 
+/*****************************************************************************
+*****************************************************************************/
+uint32_t SYS_TimerGetTime(void)
+{
+  return sysTimerTime + halTimerIrqCount * HAL_TIMER_INTERVAL;
+}
+
 /*****************************************************************************
 *****************************************************************************/
 void SYS_TimerTaskHandler(void)
@@ -119,6 +128,7 @@ void SYS_TimerTaskHandler(void)
   ATOMIC_SECTION_LEAVE
 
   elapsed = cnt * HAL_TIMER_INTERVAL;
+  sysTimerTime += elapsed;
 
   while (timers && (timers->timeout <= elapsed))
   {